@@ -0,0 +1,56 @@
+#include <Arduino.h>
+#include <SPI.h>
+
+#include "../src/hid_map.hpp"
+#include "../src/remote.hpp"
+#include "bench.hpp"
+
+#ifdef ARDUINO
+#include "../src/dispatch.hpp"
+#endif
+
+// Press and release of each mapped remote button as two sets (age byte first, 0x80 between them),
+// as the wheel would notify them
+static const uint8_t benchNotification[] = {2, 10, 3, 8, 0x80, 0, 10 | 0x80, 3 | 0x80, 8 | 0x80};
+
+void runBenchmarks() {
+  runOverheadBenchmark();
+
+#ifdef ARDUINO
+  // Decode and hand off to the output core (queue drained between iterations, not timed)
+  runBenchmark("notifyCallback", [] { xQueueReset(outputQueue); }, [] { queueNotification(benchNotification, sizeof(benchNotification), millis()); });
+#endif
+
+  runBenchmark("setRemoteState", [] {}, [] { setRemoteState(ButtonID::VOLUME_UP, true); });
+
+  static HidReports reports;
+  static HidPage page;
+  runBenchmark("updateHidReports", [] { reports = HidReports(); }, [] { updateHidReports(reports, ButtonID::UP, true, page); });
+
+  Serial.println("BENCH,done");
+}
+
+#ifdef ARDUINO
+void setup() {
+  Serial.begin(115200);
+
+  SPI.begin();
+  SPI.setDataMode(SPI_MODE0);
+  SPI.setBitOrder(MSBFIRST);
+  SPI.setClockDivider(SPI_CLOCK_DIV4);
+  pinMode(PIN_LATCH, OUTPUT);
+  digitalWrite(PIN_LATCH, HIGH);
+
+  beginOutputQueue();
+
+  delay(2000);  // Give the serial monitor time to attach
+  runBenchmarks();
+}
+
+void loop() { delay(1000); }
+#else
+int main() {
+  runBenchmarks();
+  return 0;
+}
+#endif
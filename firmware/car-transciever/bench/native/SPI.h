@@ -0,0 +1,20 @@
+#pragma once
+
+// Host stand-in for the Arduino SPI driver, transfers are discarded
+
+#include <Arduino.h>
+
+#define SPI_MODE0 0
+#define MSBFIRST 1
+#define SPI_CLOCK_DIV4 4
+
+class SPIClass {
+ public:
+  void begin() {}
+  void setDataMode(uint8_t /*mode*/) {}
+  void setBitOrder(uint8_t /*order*/) {}
+  void setClockDivider(uint8_t /*divider*/) {}
+  uint8_t transfer(uint8_t /*data*/) { return 0; }
+};
+
+inline SPIClass SPI;
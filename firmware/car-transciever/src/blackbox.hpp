@@ -0,0 +1,260 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Black box recorder, event stream kept in the "blackbox" flash partition (see partitions.csv).
+// Records are batched in RAM and appended to a ring of flash sectors, each sector is only
+// erased when the ring wraps around so wear is spread evenly over the whole partition.
+
+#define BLACKBOX_PARTITION "blackbox"
+#define BLACKBOX_SECTOR_SIZE 4096
+#define BLACKBOX_BATCH_SIZE 1024
+#define BLACKBOX_FLUSH_INTERVAL 60000  // milliseconds, partial batches are written after this
+#define BLACKBOX_QUIET_TIME 1000       // Flash writes wait for this long without output activity
+#define BLACKBOX_TASK_PRIORITY 1
+#define BLACKBOX_TASK_STACK 4096
+#define BLACKBOX_MAGIC 0x31584242  // "BBX1"
+
+// Record kinds (high nibble of the record header, 0xF is erased flash)
+enum class BlackboxRecord : uint8_t {
+  TIME = 0,        // 4 byte millis(), starts every batch
+  RECEIVED = 1,    // Button byte received from the wheel
+  OUTPUT = 2,      // Button byte applied to the outputs
+  CONNECT = 3,
+  DISCONNECT = 4,
+  ILLUMINATION = 5,  // Quantized level, 8th bit set when measured from PWM
+  LINK = 6,          // TX power step: rssi, peer rssi, tx power (signed dBm each)
+  SET = 7,           // Start of a set from the wheel: its age (10 ms units), the RECEIVED bytes follow
+};
+
+// Record header: kind << 4 | delta (ms since the previous record), delta 15 is followed by
+// a varint of (delta - 15). Kinds with a payload are followed by their payload bytes.
+#define BLACKBOX_DELTA_ESCAPE 15
+
+struct BlackboxSectorHeader {
+  uint32_t magic;
+  uint32_t sequence;
+  uint32_t bootId;
+};
+
+static const esp_partition_t* blackboxPartition = nullptr;
+static TaskHandle_t blackboxTask = nullptr;
+static portMUX_TYPE blackboxLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Double buffer, records go into the active buffer while the writer owns the other one
+static uint8_t blackboxBuffers[2][BLACKBOX_BATCH_SIZE];
+static size_t blackboxLength = 0;
+static uint8_t blackboxActive = 0;
+static volatile bool blackboxPending = false;
+static size_t blackboxPendingLength = 0;
+static volatile uint32_t blackboxDrops = 0;
+static unsigned long blackboxLastRecord = 0;
+static volatile unsigned long blackboxLastOutput = 0;
+
+// Flash position
+static uint32_t blackboxSectorCount = 0;
+static uint32_t blackboxSector = 0;
+static uint32_t blackboxOffset = BLACKBOX_SECTOR_SIZE;  // Forces a fresh sector on the first write
+static uint32_t blackboxSequence = 0;
+static uint32_t blackboxBootId = 0;
+
+// Hand the active buffer to the writer (lock must be held)
+static bool blackboxSwap() {
+  if (blackboxPending || blackboxLength == 0) {
+    return false;
+  }
+  blackboxPendingLength = blackboxLength;
+  blackboxPending = true;
+  blackboxActive ^= 1;
+  blackboxLength = 0;
+  return true;
+}
+
+// Make room for a record, starting a new batch when needed (lock must be held)
+static bool blackboxReserve(size_t length) {
+  if (blackboxLength + length > BLACKBOX_BATCH_SIZE && !blackboxSwap()) {
+    return false;  // Writer hasn't caught up
+  }
+
+  // Every batch starts with an absolute timestamp
+  if (blackboxLength == 0) {
+    unsigned long now = millis();
+    uint8_t* time = blackboxBuffers[blackboxActive];
+    time[0] = static_cast<uint8_t>(BlackboxRecord::TIME) << 4;
+    memcpy(time + 1, &now, 4);
+    blackboxLength = 5;
+    blackboxLastRecord = now;
+  }
+  return true;
+}
+
+// Record one event, never blocks (safe from the output task and BLE callbacks)
+inline void recordBlackbox(BlackboxRecord kind, const uint8_t* payload = nullptr, size_t payloadLength = 0) {
+  if (blackboxPartition == nullptr) {
+    return;
+  }
+
+  uint8_t record[8];
+  size_t length = 1;
+  bool pending;
+
+  portENTER_CRITICAL(&blackboxLock);
+  if (blackboxReserve(sizeof(record))) {
+    unsigned long now = millis();
+    uint32_t delta = now - blackboxLastRecord;
+
+    if (delta < BLACKBOX_DELTA_ESCAPE) {
+      record[0] = static_cast<uint8_t>(kind) << 4 | delta;
+    } else {
+      record[0] = static_cast<uint8_t>(kind) << 4 | BLACKBOX_DELTA_ESCAPE;
+      delta -= BLACKBOX_DELTA_ESCAPE;
+      do {
+        record[length++] = (delta & 0x7F) | (delta > 0x7F ? 0x80 : 0);
+        delta >>= 7;
+      } while (delta > 0);
+    }
+    for (size_t i = 0; i < payloadLength && length < sizeof(record); i++) {
+      record[length++] = payload[i];
+    }
+
+    memcpy(blackboxBuffers[blackboxActive] + blackboxLength, record, length);
+    blackboxLength += length;
+    blackboxLastRecord = now;
+  } else {
+    blackboxDrops++;
+  }
+  pending = blackboxPending;
+  portEXIT_CRITICAL(&blackboxLock);
+
+  if (pending && blackboxTask != nullptr) {
+    xTaskNotifyGive(blackboxTask);
+  }
+}
+
+inline void recordBlackbox(BlackboxRecord kind, uint8_t value) { recordBlackbox(kind, &value, 1); }
+
+// Output activity delays flash writes (flash operations stall both cores)
+inline void markBlackboxOutput() { blackboxLastOutput = millis(); }
+
+// Append one batch to the flash ring
+static void writeBlackboxBatch(const uint8_t* data, size_t length) {
+  if (blackboxOffset + length > BLACKBOX_SECTOR_SIZE) {
+    // Start the next sector in the ring
+    blackboxSector = (blackboxSector + 1) % blackboxSectorCount;
+    blackboxSequence++;
+    uint32_t address = blackboxSector * BLACKBOX_SECTOR_SIZE;
+
+    BlackboxSectorHeader header = {BLACKBOX_MAGIC, blackboxSequence, blackboxBootId};
+    esp_partition_erase_range(blackboxPartition, address, BLACKBOX_SECTOR_SIZE);
+    esp_partition_write(blackboxPartition, address, &header, sizeof(header));
+    blackboxOffset = sizeof(header);
+  }
+
+  esp_partition_write(blackboxPartition, blackboxSector * BLACKBOX_SECTOR_SIZE + blackboxOffset, data, length);
+  blackboxOffset += length;
+}
+
+static void writePendingBlackbox() {
+  if (!blackboxPending) {
+    return;
+  }
+
+  // Wait for the outputs to go quiet before touching flash
+  while (millis() - blackboxLastOutput < BLACKBOX_QUIET_TIME) {
+    vTaskDelay(pdMS_TO_TICKS(100));
+  }
+
+  writeBlackboxBatch(blackboxBuffers[blackboxActive ^ 1], blackboxPendingLength);
+  blackboxPending = false;
+}
+
+// Hand over a partial batch so it gets written (timed flush and dumps)
+static void flushBlackbox() {
+  portENTER_CRITICAL(&blackboxLock);
+  blackboxSwap();
+  portEXIT_CRITICAL(&blackboxLock);
+}
+
+// Only task that writes flash
+static void blackboxWriterTask(void* parameter) {
+  for (;;) {
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(BLACKBOX_FLUSH_INTERVAL)) == 0) {
+      flushBlackbox();
+    }
+    writePendingBlackbox();
+  }
+}
+
+inline void beginBlackbox(int core) {
+  blackboxPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, BLACKBOX_PARTITION);
+  if (blackboxPartition == nullptr) {
+    Serial.println("Black box partition not found, recording disabled");
+    return;
+  }
+  blackboxSectorCount = blackboxPartition->size / BLACKBOX_SECTOR_SIZE;
+  blackboxBootId = esp_random();
+
+  // Continue after the newest sector from previous runs
+  for (uint32_t sector = 0; sector < blackboxSectorCount; sector++) {
+    BlackboxSectorHeader header;
+    esp_partition_read(blackboxPartition, sector * BLACKBOX_SECTOR_SIZE, &header, sizeof(header));
+    if (header.magic == BLACKBOX_MAGIC && header.sequence >= blackboxSequence) {
+      blackboxSequence = header.sequence;
+      blackboxSector = sector;
+    }
+  }
+
+  xTaskCreatePinnedToCore(blackboxWriterTask, "blackbox", BLACKBOX_TASK_STACK, nullptr, BLACKBOX_TASK_PRIORITY, &blackboxTask, core);
+}
+
+// Stream the ring oldest first as hex lines for the host decoder:
+// BBX,S,<sequence>,<boot id> per sector, BBX,D,<hex> per 64 bytes, BBX,E,<drops> at the end
+inline void dumpBlackbox() {
+  if (blackboxPartition == nullptr) {
+    Serial.println("BBX,E,0");
+    return;
+  }
+
+  // Get everything recorded so far into flash first
+  flushBlackbox();
+  xTaskNotifyGive(blackboxTask);
+  while (blackboxPending) {
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+
+  uint8_t chunk[64];
+  for (uint32_t i = 1; i <= blackboxSectorCount; i++) {
+    uint32_t sector = (blackboxSector + i) % blackboxSectorCount;
+    uint32_t address = sector * BLACKBOX_SECTOR_SIZE;
+
+    BlackboxSectorHeader header;
+    esp_partition_read(blackboxPartition, address, &header, sizeof(header));
+    if (header.magic != BLACKBOX_MAGIC) {
+      continue;
+    }
+    Serial.printf("BBX,S,%u,%08x\n", header.sequence, header.bootId);
+
+    for (uint32_t offset = sizeof(header); offset < BLACKBOX_SECTOR_SIZE; offset += sizeof(chunk)) {
+      size_t length = min((size_t)(BLACKBOX_SECTOR_SIZE - offset), sizeof(chunk));
+      esp_partition_read(blackboxPartition, address + offset, chunk, length);
+      bool erased = true;
+      for (size_t j = 0; j < length && erased; j++) {
+        erased = chunk[j] == 0xFF;
+      }
+      if (erased) {
+        break;  // Nothing more in this sector
+      }
+
+      Serial.print("BBX,D,");
+      for (size_t j = 0; j < length; j++) {
+        Serial.printf("%02x", chunk[j]);
+      }
+      Serial.println();
+    }
+  }
+  Serial.printf("BBX,E,%u\n", blackboxDrops);
+}
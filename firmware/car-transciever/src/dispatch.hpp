@@ -0,0 +1,104 @@
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "protocol.hpp"
+#include "remote.hpp"
+
+// Core layout (Bluedroid host runs on core 0, keep connection management alongside it)
+#define BLE_CORE 0
+#define OUTPUT_CORE 1
+
+// Task configuration
+#define BLE_TASK_PRIORITY 1
+#define BLE_TASK_STACK 8192
+#define BLE_TASK_PERIOD 10  // milliseconds
+#define OUTPUT_TASK_PRIORITY (configMAX_PRIORITIES - 2)
+#define OUTPUT_TASK_STACK 4096
+#define OUTPUT_QUEUE_LENGTH 32
+#define OUTPUT_LOG_LENGTH 32
+
+// Button event decoded on the BLE core, applied on the output core
+struct OutputEvent {
+  ButtonID button;
+  bool pressed;
+  uint32_t held;  // Buttons held once the whole set is applied, indexed by ButtonID
+  unsigned long time;  // When the wheel sampled the set (local millis())
+};
+
+// BLE core -> output core
+static QueueHandle_t outputQueue = nullptr;
+static volatile uint32_t outputQueueDrops = 0;
+static uint32_t wheelHeld = 0;  // Only touched from the BLE callback
+
+// Output core -> BLE task, applied events are printed there so Serial never holds up the outputs
+static QueueHandle_t outputLogQueue = nullptr;
+
+inline void beginOutputQueue() {
+  outputQueue = xQueueCreate(OUTPUT_QUEUE_LENGTH, sizeof(OutputEvent));
+  outputLogQueue = xQueueCreate(OUTPUT_LOG_LENGTH, sizeof(OutputEvent));
+}
+
+// Never blocks, the BLE stack must not wait on the output core
+inline bool queueOutputEvent(ButtonID button, bool pressed, uint32_t held, unsigned long time) {
+  OutputEvent event = {button, pressed, held, time};
+  if (xQueueSend(outputQueue, &event, 0) != pdTRUE) {
+    outputQueueDrops++;
+    return false;
+  }
+  return true;
+}
+
+inline bool receiveOutputEvent(OutputEvent& event) { return xQueueReceive(outputQueue, &event, portMAX_DELAY) == pdTRUE; }
+
+// Never blocks, the log line is dropped if the BLE task has fallen behind
+inline void logOutputEvent(const OutputEvent& event) { xQueueSend(outputLogQueue, &event, 0); }
+
+inline bool receiveOutputLog(OutputEvent& event) { return xQueueReceive(outputLogQueue, &event, 0) == pdTRUE; }
+
+// Walk the sets in a notification from the wheel. Changes seen in the same sample arrive together
+// as [age, button bytes...], sets are split by EVENT_SET_SEPARATOR. set() gets the button bytes and
+// how many milliseconds before the notification they were sampled.
+template <typename Set>
+inline void forEachButtonSet(const uint8_t* pData, size_t length, Set set) {
+  size_t start = 0;
+  while (start < length) {
+    size_t end = start;
+    while (end < length && pData[end] != EVENT_SET_SEPARATOR) {
+      end++;
+    }
+    if (end - start > 1) {
+      set(pData + start + 1, end - start - 1, static_cast<unsigned long>(pData[start]) * EVENT_AGE_UNIT);
+    }
+    start = end + 1;
+  }
+}
+
+// Decode a notification from the wheel (one byte per button, 8th bit set on release), `now` is
+// when it arrived
+inline void queueNotification(const uint8_t* pData, size_t length, unsigned long now) {
+  forEachButtonSet(pData, length, [now](const uint8_t* values, size_t count, unsigned long age) {
+    for (size_t i = 0; i < count; i++) {
+      uint8_t buttonValue = values[i] & 0x7F;
+      if (buttonValue < 32) {
+        if (values[i] & 0x80) {
+          wheelHeld &= ~(1UL << buttonValue);
+        } else {
+          wheelHeld |= 1UL << buttonValue;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      uint8_t buttonState = values[i];
+      uint8_t buttonValue = buttonState & 0x7F;
+      bool buttonReleased = (buttonState & 0x80) != 0;         // Check 8th bit
+      ButtonID buttonID = static_cast<ButtonID>(buttonValue);  // Mask out 8th bit
+
+      queueOutputEvent(buttonID, !buttonReleased, wheelHeld, now - age);
+    }
+  });
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <Arduino.h>
+#include <BLE2902.h>
+#include <BLEDevice.h>
+#include <BLEServer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+// Fan-out service, rebroadcasts wheel events to phones/tablets while the car stays the wheel's only client
+#define FANOUT_SERVICE_UUID "4fafc202-1fb5-459e-8fcc-c5c9c331914b"
+#define FANOUT_STATE_UUID "beb5483f-36e1-4688-b7f5-ea07361b26a8"
+#define FANOUT_METRICS_UUID "beb54840-36e1-4688-b7f5-ea07361b26a8"
+#define FANOUT_MAX_SUBSCRIBERS 2
+#define FANOUT_QUEUE_LENGTH 32
+#define FANOUT_TASK_PRIORITY 1
+#define FANOUT_TASK_STACK 4096
+#define FANOUT_METRICS_INTERVAL 5000  // milliseconds
+
+// State characteristic: sent for every event, pressed is a bitmask indexed by ButtonID
+struct __attribute__((packed)) ButtonStateFrame {
+  uint32_t time;  // When the wheel sampled the change (car millis())
+  uint32_t pressed;
+  uint8_t value;  // Button byte that caused this frame (8th bit set on release)
+};
+
+// Metrics characteristic: sent every FANOUT_METRICS_INTERVAL
+struct __attribute__((packed)) MetricsFrame {
+  uint32_t uptime;
+  uint32_t freeHeap;
+  uint32_t minFreeHeap;
+  uint32_t outputDrops;
+  uint32_t fanoutDrops;
+  uint32_t blackboxDrops;
+  uint32_t connects;
+  uint32_t timeToConnectMean;
+  uint32_t timeToConnectMax;
+  int8_t rssi;     // dBm, how the car hears the wheel
+  int8_t peerRssi;  // dBm, how the wheel hears the car
+  int8_t txPower;  // dBm
+  uint32_t linkReceived;
+  uint32_t linkLost;
+};
+
+// Filled in by the main firmware
+void buildMetrics(MetricsFrame& metrics);
+
+static QueueHandle_t fanoutQueue = nullptr;
+static volatile uint32_t fanoutDrops = 0;
+static volatile uint32_t fanoutPressed = 0;
+static portMUX_TYPE fanoutLock = portMUX_INITIALIZER_UNLOCKED;
+
+static BLEServer* pFanoutServer = nullptr;
+static BLECharacteristic* pStateCharacteristic = nullptr;
+static BLECharacteristic* pMetricsCharacteristic = nullptr;
+
+// Connected phones and what each has subscribed to (from its own CCCD writes). The link to the
+// wheel also raises server events but is never listed, so it is never notified.
+struct FanoutPeer {
+  uint16_t connId;
+  bool state;
+  bool metrics;
+};
+static FanoutPeer fanoutPeers[FANOUT_MAX_SUBSCRIBERS];
+static uint8_t fanoutPeerCount = 0;
+static volatile uint8_t fanoutSubscribers = 0;  // Phones with any notification enabled
+
+static void countFanoutSubscribers() {
+  uint8_t subscribers = 0;
+  for (uint8_t i = 0; i < fanoutPeerCount; i++) {
+    if (fanoutPeers[i].state || fanoutPeers[i].metrics) {
+      subscribers++;
+    }
+  }
+  fanoutSubscribers = subscribers;
+}
+
+class FanoutServerCallbacks : public BLEServerCallbacks {
+  void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) {
+    if (param->connect.link_role != 1 || fanoutPeerCount >= FANOUT_MAX_SUBSCRIBERS) {
+      return;  // Not a peripheral link (the wheel), or no room left
+    }
+    portENTER_CRITICAL(&fanoutLock);
+    fanoutPeers[fanoutPeerCount++] = {param->connect.conn_id, false, false};
+    portEXIT_CRITICAL(&fanoutLock);
+    Serial.println("Fan-out phone connected");
+
+    // Keep advertising until the phone limit is reached
+    if (fanoutPeerCount < FANOUT_MAX_SUBSCRIBERS) {
+      BLEDevice::startAdvertising();
+    }
+  }
+
+  void onDisconnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) {
+    for (uint8_t i = 0; i < fanoutPeerCount; i++) {
+      if (fanoutPeers[i].connId == param->disconnect.conn_id) {
+        portENTER_CRITICAL(&fanoutLock);
+        fanoutPeers[i] = fanoutPeers[--fanoutPeerCount];
+        countFanoutSubscribers();
+        portEXIT_CRITICAL(&fanoutLock);
+        Serial.println("Fan-out phone disconnected");
+        BLEDevice::startAdvertising();
+        return;
+      }
+    }
+  }
+};
+
+// BLE objects live for the whole run (never reallocated)
+static FanoutServerCallbacks fanoutCallbacks;
+static BLE2902 stateDescriptor;
+static BLE2902 metricsDescriptor;
+
+// CCCD writes carry the writer's connection id only at the GATTS level (BLE2902 keeps one value
+// for every peer), so subscriptions are tracked here per phone
+static void fanoutGattsHandler(esp_gatts_cb_event_t event, esp_gatt_if_t /*gattsIf*/, esp_ble_gatts_cb_param_t* param) {
+  if (event != ESP_GATTS_WRITE_EVT || param->write.len != 2) {
+    return;
+  }
+  bool stateCccd = param->write.handle == stateDescriptor.getHandle();
+  if (!stateCccd && param->write.handle != metricsDescriptor.getHandle()) {
+    return;
+  }
+  bool enabled = (param->write.value[0] & 0x01) != 0;
+
+  portENTER_CRITICAL(&fanoutLock);
+  for (uint8_t i = 0; i < fanoutPeerCount; i++) {
+    if (fanoutPeers[i].connId == param->write.conn_id) {
+      if (stateCccd) {
+        fanoutPeers[i].state = enabled;
+      } else {
+        fanoutPeers[i].metrics = enabled;
+      }
+    }
+  }
+  countFanoutSubscribers();
+  portEXIT_CRITICAL(&fanoutLock);
+}
+
+// Notify every phone subscribed to the state or metrics characteristic (the value is also kept for reads)
+static void notifyFanout(BLECharacteristic* pCharacteristic, bool metrics, uint8_t* data, size_t length) {
+  pCharacteristic->setValue(data, length);
+
+  FanoutPeer peers[FANOUT_MAX_SUBSCRIBERS];
+  portENTER_CRITICAL(&fanoutLock);
+  uint8_t count = fanoutPeerCount;
+  memcpy(peers, fanoutPeers, sizeof(peers));
+  portEXIT_CRITICAL(&fanoutLock);
+
+  for (uint8_t i = 0; i < count; i++) {
+    if (metrics ? peers[i].metrics : peers[i].state) {
+      esp_ble_gatts_send_indicate(pFanoutServer->getGattsIf(), peers[i].connId, pCharacteristic->getHandle(), length, data, false);
+    }
+  }
+}
+
+// Called from the BLE callback for every wheel byte with the time it was sampled, never blocks
+inline void queueFanout(uint8_t value, unsigned long time) {
+  uint8_t id = value & 0x7F;
+  ButtonStateFrame frame;
+
+  // The mask is updated here so frames stay correct even when the queue overflows
+  portENTER_CRITICAL(&fanoutLock);
+  if (id < 32) {
+    if (value & 0x80) {
+      fanoutPressed &= ~(1UL << id);
+    } else {
+      fanoutPressed |= 1UL << id;
+    }
+  }
+  frame.pressed = fanoutPressed;
+  portEXIT_CRITICAL(&fanoutLock);
+
+  frame.time = time;
+  frame.value = value;
+  if (xQueueSend(fanoutQueue, &frame, 0) != pdTRUE) {
+    fanoutDrops++;
+  }
+}
+
+static void fanoutTask(void* parameter) {
+  unsigned long lastMetrics = 0;
+  ButtonStateFrame frame;
+
+  for (;;) {
+    if (xQueueReceive(fanoutQueue, &frame, pdMS_TO_TICKS(FANOUT_METRICS_INTERVAL)) == pdTRUE && fanoutSubscribers > 0) {
+      notifyFanout(pStateCharacteristic, false, reinterpret_cast<uint8_t*>(&frame), sizeof(frame));
+    }
+
+    if (millis() - lastMetrics >= FANOUT_METRICS_INTERVAL) {
+      MetricsFrame metrics = {};
+      buildMetrics(metrics);
+      notifyFanout(pMetricsCharacteristic, true, reinterpret_cast<uint8_t*>(&metrics), sizeof(metrics));
+      lastMetrics = millis();
+    }
+  }
+}
+
+// Start the peripheral role next to the wheel client (call after BLEDevice::init)
+inline void beginFanout(int core) {
+  fanoutQueue = xQueueCreate(FANOUT_QUEUE_LENGTH, sizeof(ButtonStateFrame));
+
+  pFanoutServer = BLEDevice::createServer();
+  pFanoutServer->setCallbacks(&fanoutCallbacks);
+  BLEDevice::setCustomGattsHandler(fanoutGattsHandler);
+
+  BLEService* pService = pFanoutServer->createService(FANOUT_SERVICE_UUID);
+  pStateCharacteristic = pService->createCharacteristic(FANOUT_STATE_UUID, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY);
+  pStateCharacteristic->addDescriptor(&stateDescriptor);
+  pMetricsCharacteristic = pService->createCharacteristic(FANOUT_METRICS_UUID, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY);
+  pMetricsCharacteristic->addDescriptor(&metricsDescriptor);
+  pService->start();
+
+  BLEAdvertising* pAdvertising = BLEDevice::getAdvertising();
+  pAdvertising->addServiceUUID(FANOUT_SERVICE_UUID);
+  pAdvertising->setScanResponse(true);
+  BLEDevice::startAdvertising();
+
+  xTaskCreatePinnedToCore(fanoutTask, "fanout", FANOUT_TASK_STACK, nullptr, FANOUT_TASK_PRIORITY, nullptr, core);
+}
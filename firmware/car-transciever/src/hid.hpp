@@ -0,0 +1,43 @@
+#pragma once
+
+// USB HID output backend, presents the car transceiver to the head unit as a
+// consumer control + keyboard device (requires USB OTG mode, see the usb_hid env)
+
+#include <Arduino.h>
+#include <USB.h>
+#include <USBHIDConsumerControl.h>
+#include <USBHIDKeyboard.h>
+#include <string.h>
+
+#include "hid_map.hpp"
+
+static USBHIDConsumerControl ConsumerControl;
+static USBHIDKeyboard Keyboard;
+static HidReports hidReports = {};
+
+inline void beginHidOutput() {
+  ConsumerControl.begin();
+  Keyboard.begin();
+  USB.productName("Toyota Steering Wheel");
+  USB.begin();
+}
+
+// Function to set HID output for a button
+inline void setHidState(ButtonID button, bool isPressed) {
+  HidPage page;
+  if (!updateHidReports(hidReports, button, isPressed, page)) {
+    return;
+  }
+
+  if (page == HidPage::CONSUMER) {
+    if (hidReports.consumer) {
+      ConsumerControl.press(hidReports.consumer);
+    } else {
+      ConsumerControl.release();
+    }
+  } else {
+    KeyReport report;
+    memcpy(&report, hidReports.keyboard, sizeof(report));
+    Keyboard.sendReport(&report);
+  }
+}
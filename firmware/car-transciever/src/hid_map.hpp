@@ -0,0 +1,88 @@
+#pragma once
+
+#include <map>
+
+#include "remote.hpp"
+
+// HID usage pages used by the USB output backend
+enum class HidPage : uint8_t {
+  KEYBOARD = 0x07,
+  CONSUMER = 0x0C,
+};
+
+struct HidUsage {
+  HidPage page;
+  uint16_t usage;
+};
+
+// Map ButtonID to HID usage (media keys on the consumer page, navigation on the keyboard page)
+const std::map<ButtonID, HidUsage> BUTTON_HID_MAP = {
+    // Volume and media controls
+    {ButtonID::VOLUME_UP, {HidPage::CONSUMER, 0x00E9}},    // Volume Increment
+    {ButtonID::VOLUME_DOWN, {HidPage::CONSUMER, 0x00EA}},  // Volume Decrement
+    {ButtonID::NEXT_SONG, {HidPage::CONSUMER, 0x00B5}},    // Scan Next Track
+    {ButtonID::PREV_SONG, {HidPage::CONSUMER, 0x00B6}},    // Scan Previous Track
+
+    // Phone and assistant
+    {ButtonID::PHONE, {HidPage::CONSUMER, 0x008C}},      // Media Select Telephone
+    {ButtonID::ASSISTANT, {HidPage::CONSUMER, 0x00CF}},  // Voice Command
+    {ButtonID::RETURN, {HidPage::CONSUMER, 0x0224}},     // AC Back
+    {ButtonID::MODE, {HidPage::CONSUMER, 0x0223}},       // AC Home
+
+    // Navigation
+    {ButtonID::UP, {HidPage::KEYBOARD, 0x52}},     // Up Arrow
+    {ButtonID::DOWN, {HidPage::KEYBOARD, 0x51}},   // Down Arrow
+    {ButtonID::LEFT, {HidPage::KEYBOARD, 0x50}},   // Left Arrow
+    {ButtonID::RIGHT, {HidPage::KEYBOARD, 0x4F}},  // Right Arrow
+    {ButtonID::OK, {HidPage::KEYBOARD, 0x28}},     // Enter
+};
+
+// Contents of the consumer control (16 bit usage) and boot keyboard (modifiers, reserved, 6 keys) reports
+struct HidReports {
+  uint16_t consumer;
+  uint8_t keyboard[8];
+};
+
+// Apply a button change to the reports, returns true (with the page) when a report changed.
+// The consumer report holds one usage, so releasing an older button never cancels a newer press.
+inline bool updateHidReports(HidReports& reports, ButtonID button, bool isPressed, HidPage& changedPage) {
+  auto it = BUTTON_HID_MAP.find(button);
+  if (it == BUTTON_HID_MAP.end()) {
+    return false;
+  }
+  const HidUsage& usage = it->second;
+  changedPage = usage.page;
+
+  if (usage.page == HidPage::CONSUMER) {
+    if (isPressed && reports.consumer != usage.usage) {
+      reports.consumer = usage.usage;
+      return true;
+    }
+    if (!isPressed && reports.consumer == usage.usage) {
+      reports.consumer = 0;
+      return true;
+    }
+    return false;
+  }
+
+  // Keyboard report, key slots are bytes 2 to 7
+  uint8_t key = static_cast<uint8_t>(usage.usage);
+  for (int i = 2; i < 8; i++) {
+    if (reports.keyboard[i] == key) {
+      if (isPressed) {
+        return false;
+      }
+      reports.keyboard[i] = 0;
+      return true;
+    }
+  }
+  if (isPressed) {
+    for (int i = 2; i < 8; i++) {
+      if (reports.keyboard[i] == 0) {
+        reports.keyboard[i] = key;
+        return true;
+      }
+    }
+  }
+  return false;
+}
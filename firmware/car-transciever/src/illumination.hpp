@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Arduino.h>
+#include <driver/mcpwm.h>
+
+// Dash illumination input (dimmer rheostat PWM from the car)
+#define PIN_INTERIOR D0
+
+// Capture configuration (MCPWM capture timer runs from the 80MHz APB clock)
+#define ILLUMINATION_CAPTURE_HZ 80000000UL
+#define ILLUMINATION_SIGNAL_TIMEOUT 100  // milliseconds without edges before falling back to on/off
+#define ILLUMINATION_LEVELS 16           // Quantized brightness steps forwarded to the wheel
+#define ILLUMINATION_HYSTERESIS 20       // permille beyond a step boundary before the level changes
+
+struct IlluminationState {
+  bool on;             // On/off state (fallback when the input is not switching)
+  uint8_t level;       // Quantized brightness (0 to ILLUMINATION_LEVELS - 1)
+  uint16_t dutyPermille;
+  uint32_t frequencyHz;
+  bool pwm;            // True when the level was measured from a PWM signal
+};
+
+// Edge timestamps written from the capture ISR
+static volatile uint32_t illuminationRiseTicks = 0;
+static volatile uint32_t illuminationHighTicks = 0;
+static volatile uint32_t illuminationPeriodTicks = 0;
+static volatile uint32_t illuminationLastEdgeMillis = 0;
+
+static uint8_t illuminationLevel = 0;
+
+static bool IRAM_ATTR illuminationCaptureISR(mcpwm_unit_t unit, mcpwm_capture_channel_id_t channel, const cap_event_data_t* edata, void* userData) {
+  if (edata->cap_edge == MCPWM_POS_EDGE) {
+    illuminationPeriodTicks = edata->cap_value - illuminationRiseTicks;
+    illuminationRiseTicks = edata->cap_value;
+  } else {
+    illuminationHighTicks = edata->cap_value - illuminationRiseTicks;
+  }
+  illuminationLastEdgeMillis = millis();
+  return false;  // No task woken
+}
+
+inline void beginIlluminationCapture() {
+  pinMode(PIN_INTERIOR, INPUT);
+
+  mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM_CAP_0, PIN_INTERIOR);
+
+  mcpwm_capture_config_t config = {};
+  config.cap_edge = MCPWM_BOTH_EDGE;
+  config.cap_prescale = 1;
+  config.capture_cb = illuminationCaptureISR;
+  config.user_data = nullptr;
+  mcpwm_capture_enable_channel(MCPWM_UNIT_0, MCPWM_SELECT_CAP0, &config);
+}
+
+// Quantize a duty cycle to a brightness level, only moving away from the current level
+// once the duty is clearly past the step boundary (prevents chatter from rheostat noise)
+inline uint8_t quantizeIllumination(uint16_t dutyPermille, uint8_t currentLevel) {
+  const uint16_t step = 1000 / (ILLUMINATION_LEVELS - 1);
+  uint16_t center = currentLevel * step;
+
+  if (dutyPermille + step / 2 + ILLUMINATION_HYSTERESIS < center || dutyPermille > center + step / 2 + ILLUMINATION_HYSTERESIS) {
+    uint16_t level = (dutyPermille + step / 2) / step;
+    return level >= ILLUMINATION_LEVELS ? ILLUMINATION_LEVELS - 1 : level;
+  }
+  return currentLevel;
+}
+
+inline IlluminationState readIllumination() {
+  IlluminationState state = {};
+
+  noInterrupts();
+  uint32_t highTicks = illuminationHighTicks;
+  uint32_t periodTicks = illuminationPeriodTicks;
+  uint32_t lastEdge = illuminationLastEdgeMillis;
+  interrupts();
+
+  if (periodTicks > 0 && highTicks <= periodTicks && millis() - lastEdge < ILLUMINATION_SIGNAL_TIMEOUT) {
+    state.pwm = true;
+    state.dutyPermille = (uint64_t)highTicks * 1000 / periodTicks;
+    state.frequencyHz = ILLUMINATION_CAPTURE_HZ / periodTicks;
+    illuminationLevel = quantizeIllumination(state.dutyPermille, illuminationLevel);
+  } else {
+    // Input is not switching, fall back to a plain on/off reading
+    state.pwm = false;
+    state.dutyPermille = digitalRead(PIN_INTERIOR) == HIGH ? 1000 : 0;
+    illuminationLevel = state.dutyPermille ? ILLUMINATION_LEVELS - 1 : 0;
+  }
+
+  state.level = illuminationLevel;
+  state.on = state.level > 0;
+  return state;
+}
+
+// Scale a quantized level to the 8 bit brightness sent to the wheel
+inline uint8_t illuminationBrightness(uint8_t level) { return (uint16_t)level * 255 / (ILLUMINATION_LEVELS - 1); }
@@ -3,7 +3,19 @@
 #include <BLEDevice.h>
 #include <SPI.h>
 
+#include "blackbox.hpp"
+#include "console.hpp"
+#include "discovery.hpp"
+#include "dispatch.hpp"
+#include "fanout.hpp"
+#include "illumination.hpp"
+#include "link.hpp"
 #include "remote.hpp"
+#include "stats.hpp"
+
+#ifdef OUTPUT_USB_HID
+#include "hid.hpp"
+#endif
 
 static BLEUUID serviceUUID("4fafc201-1fb5-459e-8fcc-c5c9c331914b");
 static BLEUUID charUUID("beb5483e-36e1-4688-b7f5-ea07361b26a8");
@@ -11,59 +23,144 @@ static BLEUUID charUUID("beb5483e-36e1-4688-b7f5-ea07361b26a8");
 // use hardware SPI
 // implement remote logic
 
-#define PIN_INTERIOR D0
 #define PIN_HORN D1
 #define PIN_CLOCK SCK
 #define PIN_DATA MOSI
 
-static boolean doConnect = false;
-static boolean connected = false;
-static boolean doScan = false;
+// Scans run for this long and are restarted from the BLE task (bounds the stored scan results)
+#define SCAN_DURATION 10  // seconds
+
+// Scan backoff step, parameters apply from `after` milliseconds into the discovery phase
+struct ScanStep {
+  unsigned long after;
+  uint16_t interval;  // milliseconds
+  uint16_t window;    // milliseconds
+};
+
+// Full duty scanning right after boot or a disconnect, then exponential backoff (each step
+// lasts twice as long as the one before, the duty cycle only goes down)
+const ScanStep SCAN_STEPS[] = {
+    {0, 60, 60},          // 0-10s, 100% duty
+    {10000, 160, 80},     // 10-30s, 50%
+    {30000, 640, 160},    // 30-70s, 25%
+    {70000, 1280, 192},   // 70-150s, 15%
+    {150000, 2560, 256},  // From 150s, 10%
+};
+const uint8_t SCAN_STEP_COUNT = sizeof(SCAN_STEPS) / sizeof(SCAN_STEPS[0]);
+
+static volatile boolean doConnect = false;
+static volatile boolean connected = false;
+static volatile boolean doScan = false;
+static volatile boolean doRestartDiscovery = false;
+static volatile unsigned long discoveredAt = 0;
 static BLERemoteCharacteristic* pRemoteCharacteristic;
-static BLEAdvertisedDevice* myDevice;
+static esp_bd_addr_t wheelAddress;
+static esp_ble_addr_type_t wheelAddressType;
 static BLEClient* pClient;
-static bool lastInteriorLightState = false;
+static DiscoveryScheduler scanScheduler;
+static LatencyHistogram timeToDiscover;
+static LatencyHistogram timeToConnect;
+static int16_t lastIlluminationLevel = -1;  // -1 forces the first reading to be sent
+static int16_t lastRecordedIlluminationLevel = -1;
 
 // Number of shift registers
 const int NUM_REGISTERS = 3;
 const int NUM_OUTPUTS = NUM_REGISTERS * 8;  // Total number of outputs (8 outputs per register * 3 registers)
 
-static void notifyCallback(BLERemoteCharacteristic* pBLERemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify) {
-  for (int i = 0; i < length; i++) {
-    uint8_t buttonState = pData[i];
-    uint8_t buttonValue = buttonState & 0x7F;
-    bool buttonReleased = (buttonState & 0x80) != 0;         // Check 8th bit
-    ButtonID buttonID = static_cast<ButtonID>(buttonValue);  // Mask out 8th bit
-
-    if (buttonReleased) {
-      digitalWrite(LED_BUILTIN, HIGH);
-
-      // Turn off horn
-      if (buttonValue == 22) {
-        digitalWrite(PIN_HORN, LOW);
-      }
+// Head unit output backend (AUX resistance emulation by default, USB HID with OUTPUT_USB_HID)
+static void setOutputState(ButtonID button, bool isPressed) {
+#ifdef OUTPUT_USB_HID
+  setHidState(button, isPressed);
+#else
+  setRemoteState(button, isPressed);
+#endif
+}
+
+// Ladder fault reports from the wheel have no output
+static bool isLadderFault(ButtonID button) {
+  return button == ButtonID::FAULT_A0 || button == ButtonID::FAULT_A1 || button == ButtonID::FAULT_A2;
+}
+
+// Runs on the output core, owns the horn, LED and remote outputs (logging is left to the BLE task)
+static void dispatchOutput(const OutputEvent& event) {
+  uint8_t buttonValue = static_cast<uint8_t>(event.button);
+  recordStatsChange(event.pressed ? buttonValue : buttonValue | 0x80, event.time);
+  logOutputEvent(event);
+
+  if (isLadderFault(event.button)) {
+    return;
+  }
 
-      // Set remote output state for button
-      setRemoteState(buttonID, false);
+  recordBlackbox(BlackboxRecord::OUTPUT, event.pressed ? buttonValue : buttonValue | 0x80);
+  markBlackboxOutput();
 
+  if (!event.pressed) {
+    digitalWrite(LED_BUILTIN, HIGH);
+
+    // Turn off horn
+    if (event.button == ButtonID::HORN) {
+      digitalWrite(PIN_HORN, LOW);
+    }
+
+    // Set head unit output state for button
+    setOutputState(event.button, false);
+  } else {
+    digitalWrite(LED_BUILTIN, LOW);
+
+    // Turn on horn
+    if (event.button == ButtonID::HORN) {
+      digitalWrite(PIN_HORN, HIGH);
+    }
+
+    // Set head unit output state for button
+    setOutputState(event.button, true);
+  }
+}
+
+// Runs on the BLE task, prints the events the output core has applied
+static void printOutputLog() {
+  OutputEvent event;
+  while (receiveOutputLog(event)) {
+    uint8_t buttonValue = static_cast<uint8_t>(event.button);
+    if (isLadderFault(event.button)) {
+      Serial.print("Wheel A");
+      Serial.print(buttonValue - static_cast<uint8_t>(ButtonID::FAULT_A0));
+      Serial.print(" ladder ");
+      Serial.println(event.pressed ? "degraded" : "recovered");
+    } else if (!event.pressed) {
       Serial.print(buttonValue);
       Serial.println(" released");
     } else {
-      digitalWrite(LED_BUILTIN, LOW);
+      Serial.print(buttonValue);
+      Serial.print(" pressed");
 
-      // Turn on horn
-      if (buttonValue == 22) {
-        digitalWrite(PIN_HORN, HIGH);
+      // Other buttons held alongside this one (chord)
+      uint32_t others = event.held & ~(1UL << buttonValue);
+      if (others != 0) {
+        Serial.print(" with 0x");
+        Serial.print(others, HEX);
       }
-
-      // Set remote output state for button
-      setRemoteState(buttonID, true);
-
-      Serial.print(buttonValue);
-      Serial.println(" pressed");
+      Serial.println();
     }
   }
-  Serial.println();
+}
+
+// Runs in the BLE host context, only decodes and hands events to the output core
+static void notifyCallback(BLERemoteCharacteristic* pBLERemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify) {
+  // Every notification starts with the wheel's link report
+  size_t header = receiveLinkReport(pData, length);
+  pData += header;
+  length -= header;
+
+  unsigned long now = millis();
+  queueNotification(pData, length, now);
+  forEachButtonSet(pData, length, [now](const uint8_t* values, size_t count, unsigned long age) {
+    recordBlackbox(BlackboxRecord::SET, static_cast<uint8_t>(age / EVENT_AGE_UNIT));
+    for (size_t i = 0; i < count; i++) {
+      recordBlackbox(BlackboxRecord::RECEIVED, values[i]);
+      queueFanout(values[i], now - age);
+    }
+  });
 }
 
 class MyClientCallback : public BLEClientCallbacks {
@@ -72,8 +169,11 @@ class MyClientCallback : public BLEClientCallbacks {
   void onDisconnect(BLEClient* pClient) {
     connected = false;
     Serial.println("Disconnected from server");
+    recordBlackbox(BlackboxRecord::DISCONNECT);
+    reportHeap();
     doConnect = false;
     doScan = true;
+    doRestartDiscovery = true;
   }
 };
 
@@ -81,22 +181,51 @@ class MyAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
   void onResult(BLEAdvertisedDevice advertisedDevice) {
     if (advertisedDevice.haveServiceUUID() && advertisedDevice.isAdvertisingService(serviceUUID)) {
       BLEDevice::getScan()->stop();
-      myDevice = new BLEAdvertisedDevice(advertisedDevice);
+      discoveredAt = millis();
+      memcpy(wheelAddress, *advertisedDevice.getAddress().getNative(), sizeof(wheelAddress));
+      wheelAddressType = advertisedDevice.getAddressType();
       doConnect = true;
       doScan = false;
     }
   }
 };
 
-bool connectToServer() {
-  pClient = BLEDevice::createClient();
-  pClient->setClientCallbacks(new MyClientCallback());
+// A finished scan is restarted by updateConnection() with the current backoff step
+static void scanComplete(BLEScanResults /*results*/) {
+  if (!doConnect) {
+    doScan = true;
+  }
+}
+
+// BLE objects live for the whole run (never reallocated)
+static MyClientCallback clientCallbacks;
+static MyAdvertisedDeviceCallbacks advertisedDeviceCallbacks;
+
+static uint32_t connectCount = 0;
+
+void buildMetrics(MetricsFrame& metrics) {
+  metrics.uptime = millis();
+  metrics.freeHeap = ESP.getFreeHeap();
+  metrics.minFreeHeap = ESP.getMinFreeHeap();
+  metrics.outputDrops = outputQueueDrops;
+  metrics.fanoutDrops = fanoutDrops;
+  metrics.blackboxDrops = blackboxDrops;
+  metrics.connects = connectCount;
+  metrics.timeToConnectMean = timeToConnect.count ? timeToConnect.sum / timeToConnect.count : 0;
+  metrics.timeToConnectMax = timeToConnect.max;
+  metrics.rssi = linkQuality.rssi;
+  metrics.peerRssi = linkQuality.peerRssi;
+  metrics.txPower = linkPowerDbm();
+  metrics.linkReceived = linkQuality.received;
+  metrics.linkLost = linkQuality.lost;
+}
 
+bool connectToServer() {
   unsigned long connectStartTime = millis();
   const unsigned long CONNECTION_TIMEOUT = 5000;
 
   while (!pClient->isConnected() && (millis() - connectStartTime) < CONNECTION_TIMEOUT) {
-    pClient->connect(myDevice);
+    pClient->connect(BLEAddress(wheelAddress), wheelAddressType);
     delay(500);
   }
 
@@ -117,17 +246,136 @@ bool connectToServer() {
     return false;
   }
 
+  if (pRemoteCharacteristic->canNotify()) {
+    pRemoteCharacteristic->registerForNotify(notifyCallback);
+  }
+
+  resetLink();
   connected = true;
   return true;
 }
 
 void startScan() {
   BLEScan* pBLEScan = BLEDevice::getScan();
-  pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks());
-  pBLEScan->setInterval(1349);
-  pBLEScan->setWindow(449);
+  pBLEScan->setAdvertisedDeviceCallbacks(&advertisedDeviceCallbacks);
+  pBLEScan->clearResults();  // Free results kept from the previous scan
+  pBLEScan->setInterval(SCAN_STEPS[scanScheduler.step].interval);
+  pBLEScan->setWindow(SCAN_STEPS[scanScheduler.step].window);
   pBLEScan->setActiveScan(true);
-  pBLEScan->start(0, false);
+  pBLEScan->start(SCAN_DURATION, scanComplete, false);  // Returns straight away
+}
+
+void updateConnection() {
+  updateHeapReport(millis());
+
+  if (doRestartDiscovery) {
+    resetDiscovery(scanScheduler, millis());
+    doRestartDiscovery = false;
+  }
+
+  if (doConnect) {
+    if (!scanScheduler.discovered) {
+      recordLatency(timeToDiscover, discoveredAt - scanScheduler.phaseStart);
+      scanScheduler.discovered = true;
+    }
+
+    if (connectToServer()) {
+      Serial.println("Connected");
+      recordBlackbox(BlackboxRecord::CONNECT);
+      connectCount++;
+      reportHeap();
+      recordLatency(timeToConnect, millis() - scanScheduler.phaseStart);
+      printLatencyHistogram("TTD", timeToDiscover);
+      printLatencyHistogram("TTC", timeToConnect);
+    } else {
+      Serial.println("Connection failed");
+      doScan = true;
+    }
+    doConnect = false;
+  }
+
+  // Back off the scan duty cycle the longer the wheel stays undiscovered (the running scan is
+  // stopped and restarted with the new interval and window)
+  if (!connected && !doConnect && updateDiscovery(scanScheduler, SCAN_STEPS, SCAN_STEP_COUNT, millis())) {
+    BLEDevice::getScan()->stop();
+    doScan = true;
+  }
+
+  if (!connected && doScan) {
+    startScan();
+    doScan = false;
+  }
+
+  // Illumination changes are recorded even while the wheel is away
+  IlluminationState illumination = readIllumination();
+  if (illumination.level != lastRecordedIlluminationLevel) {
+    recordBlackbox(BlackboxRecord::ILLUMINATION, illumination.pwm ? illumination.level | 0x80 : illumination.level);
+    lastRecordedIlluminationLevel = illumination.level;
+  }
+
+  if (connected) {
+    if (illumination.level != lastIlluminationLevel) {
+      uint8_t stateToSend[2] = {static_cast<uint8_t>(ButtonID::BACKLIGHT), illuminationBrightness(illumination.level)};
+      if (!illumination.on) {
+        stateToSend[0] |= 0x80;  // Set 8th bit if turning off
+      }
+
+      // Brightness byte is only sent when measured from PWM (wheel treats a single byte as on/off)
+      pRemoteCharacteristic->writeValue(stateToSend, illumination.pwm ? 2 : 1);
+      lastIlluminationLevel = illumination.level;
+
+      Serial.print("Illumination ");
+      Serial.print(illumination.dutyPermille);
+      Serial.print("/1000 @ ");
+      Serial.print(illumination.frequencyHz);
+      Serial.println("Hz");
+    }
+
+    // Link report to the wheel, and TX power steered by how the wheel hears us.
+    // Phones on the fan-out share the radio, so power only goes down while none are subscribed.
+    unsigned long now = millis();
+    if (linkReportDue(now)) {
+      uint8_t report[LINK_HEADER_SIZE];
+      writeLinkHeader(report, now);
+      pRemoteCharacteristic->writeValue(report, sizeof(report));
+      requestLinkRssi(wheelAddress);
+    }
+    if (updateLinkPower(now, fanoutSubscribers == 0)) {
+      uint8_t record[3] = {static_cast<uint8_t>(linkQuality.rssi), static_cast<uint8_t>(linkQuality.peerRssi), static_cast<uint8_t>(linkPowerDbm())};
+      recordBlackbox(BlackboxRecord::LINK, record, sizeof(record));
+    }
+    if (linkPrintDue(now)) {
+      printLink(now);
+    }
+  }
+}
+
+// Serial commands: "dump" streams the black box log, "stats" prints the usage counters
+// ("stats clear" resets them)
+static const ConsoleCommand SERIAL_COMMANDS[] = {
+    {"dump", dumpBlackbox},
+    {"stats", printStats},
+    {"stats clear", clearStats},
+};
+static const uint8_t SERIAL_COMMAND_COUNT = sizeof(SERIAL_COMMANDS) / sizeof(SERIAL_COMMANDS[0]);
+
+static void outputTask(void* parameter) {
+  OutputEvent event;
+  for (;;) {
+    if (receiveOutputEvent(event)) {
+      dispatchOutput(event);
+    }
+  }
+}
+
+static void bleTask(void* parameter) {
+  for (;;) {
+    updateConnection();
+    printOutputLog();
+    updateStats(millis());
+    handleSerialCommands(SERIAL_COMMANDS, SERIAL_COMMAND_COUNT);
+    vTaskDelay(pdMS_TO_TICKS(BLE_TASK_PERIOD));
+  }
 }
 
 void setup() {
@@ -136,6 +384,11 @@ void setup() {
 
   Serial.begin(115200);
   BLEDevice::init("XIAO_ESP32S3_CLIENT");
+  beginLink();
+
+  // Single client reused for every connection attempt
+  pClient = BLEDevice::createClient();
+  pClient->setClientCallbacks(&clientCallbacks);
 
   // Initialise SPI
   SPI.begin();
@@ -148,7 +401,6 @@ void setup() {
   digitalWrite(LED_BUILTIN, HIGH);
 
   // Initialise other pins
-  pinMode(PIN_INTERIOR, INPUT);
   pinMode(PIN_HORN, OUTPUT);
   pinMode(PIN_LATCH, OUTPUT);
 
@@ -160,41 +412,32 @@ void setup() {
   SPI.transfer(0);
   digitalWrite(PIN_LATCH, HIGH);
 
-  // Start BLE scanning
-  startScan();
-}
+#ifdef OUTPUT_USB_HID
+  // Enumerate as a HID device on the head unit's USB port
+  beginHidOutput();
+#endif
 
-void loop() {
-  if (doConnect) {
-    if (connectToServer()) {
-      Serial.println("Connected");
-    } else {
-      Serial.println("Connection failed");
-      doScan = true;
-    }
-    doConnect = false;
-  }
+  // Measure the dash illumination duty cycle in hardware
+  beginIlluminationCapture();
 
-  if (!connected && doScan) {
-    startScan();
-    doScan = false;
-  }
+  // Event recorder, flash writes happen on the BLE core
+  beginBlackbox(BLE_CORE);
 
-  if (connected) {
-    bool currentInteriorLightState = digitalRead(PIN_INTERIOR) == HIGH;
-    if (currentInteriorLightState != lastInteriorLightState) {
-      uint8_t stateToSend = static_cast<uint8_t>(ButtonID::BACKLIGHT);
-      if (!currentInteriorLightState) {
-        stateToSend |= 0x80;  // Set 8th bit if turning off
-      }
-      pRemoteCharacteristic->writeValue(&stateToSend, 1);
-      lastInteriorLightState = currentInteriorLightState;
-    }
+  // Usage counters, flushed to NVS from the BLE task
+  beginStats();
 
-    if (pRemoteCharacteristic->canNotify()) {
-      pRemoteCharacteristic->registerForNotify(notifyCallback);
-    }
-  }
+  // Peripheral role for phones, notifications are sent from a low priority task on the BLE core
+  beginFanout(BLE_CORE);
+
+  // Output dispatch on its own core, above the BLE host priority
+  beginOutputQueue();
+  xTaskCreatePinnedToCore(outputTask, "output", OUTPUT_TASK_STACK, nullptr, OUTPUT_TASK_PRIORITY, nullptr, OUTPUT_CORE);
+
+  // Scanning, connection management and uplink writes stay on the BLE core
+  doScan = true;
+  doRestartDiscovery = true;
+  xTaskCreatePinnedToCore(bleTask, "ble", BLE_TASK_STACK, nullptr, BLE_TASK_PRIORITY, nullptr, BLE_CORE);
+}
 
-  delay(10);
-}
\ No newline at end of file
+// Everything runs in the pinned tasks
+void loop() { vTaskDelete(nullptr); }
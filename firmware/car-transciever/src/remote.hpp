@@ -3,6 +3,8 @@
 #include <Arduino.h>
 #include <map>
 
+#include "button_id.hpp"
+
 // PWM Configuration
 #define PIN_LATCH D2
 
@@ -10,32 +12,6 @@ struct PWMConfig {
   uint16_t value;
 };
 
-enum class ButtonID : uint8_t {
-  NONE = 0,
-  MODE = 1,
-  LEFT = 2,
-  NEXT_SONG = 3,
-  OK = 4,
-  UP = 5,
-  PREV_SONG = 6,
-  RETURN = 7,
-  PHONE = 8,
-  DOWN = 9,
-  VOLUME_UP = 10,
-  ASSISTANT = 11,
-  RIGHT = 12,
-  VOLUME_DOWN = 13,
-  CRUISE_CONTROL = 14,
-  CANCEL = 15,
-  CC_PLUS = 16,
-  CC_MINUS = 17,
-  RADAR = 18,
-  LANE_ASSIST = 19,
-  PADDLE_LEFT = 20,
-  PADDLE_RIGHT = 21,
-  HORN = 22,
-  BACKLIGHT = 23,  // Receive only
-};
 
 // Map ButtonID to PWM configuration
 const std::map<ButtonID, uint8_t> BUTTON_SPI_MAP = {
@@ -60,8 +36,6 @@ const std::map<ButtonID, uint8_t> BUTTON_SPI_MAP = {
 inline void setRemoteState(ButtonID button, bool isPressed) {
   auto it = BUTTON_SPI_MAP.find(button);
   if (it != BUTTON_SPI_MAP.end()) {
-    Serial.println(static_cast<int>(button));
-
     // Pull latch pin low to start transfer
     digitalWrite(PIN_LATCH, LOW);
 
@@ -0,0 +1,163 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <unity.h>
+
+#include "../../src/hid_map.hpp"
+
+// Report bytes produced by the HID mapping (pio test -e native)
+
+struct ExpectedUsage {
+  ButtonID button;
+  HidPage page;
+  uint16_t usage;
+};
+
+// Written out independently of BUTTON_HID_MAP so a changed usage fails here
+static const ExpectedUsage EXPECTED_USAGES[] = {
+    {ButtonID::VOLUME_UP, HidPage::CONSUMER, 0x00E9},
+    {ButtonID::VOLUME_DOWN, HidPage::CONSUMER, 0x00EA},
+    {ButtonID::NEXT_SONG, HidPage::CONSUMER, 0x00B5},
+    {ButtonID::PREV_SONG, HidPage::CONSUMER, 0x00B6},
+    {ButtonID::PHONE, HidPage::CONSUMER, 0x008C},
+    {ButtonID::ASSISTANT, HidPage::CONSUMER, 0x00CF},
+    {ButtonID::RETURN, HidPage::CONSUMER, 0x0224},
+    {ButtonID::MODE, HidPage::CONSUMER, 0x0223},
+    {ButtonID::UP, HidPage::KEYBOARD, 0x52},
+    {ButtonID::DOWN, HidPage::KEYBOARD, 0x51},
+    {ButtonID::LEFT, HidPage::KEYBOARD, 0x50},
+    {ButtonID::RIGHT, HidPage::KEYBOARD, 0x4F},
+    {ButtonID::OK, HidPage::KEYBOARD, 0x28},
+};
+static const size_t EXPECTED_USAGE_COUNT = sizeof(EXPECTED_USAGES) / sizeof(EXPECTED_USAGES[0]);
+
+// Buttons with no HID output (handled on the car, or not forwarded to the head unit)
+static const ButtonID UNMAPPED_BUTTONS[] = {
+    ButtonID::NONE,
+    ButtonID::CRUISE_CONTROL,
+    ButtonID::CANCEL,
+    ButtonID::CC_PLUS,
+    ButtonID::CC_MINUS,
+    ButtonID::RADAR,
+    ButtonID::LANE_ASSIST,
+    ButtonID::PADDLE_LEFT,
+    ButtonID::PADDLE_RIGHT,
+    ButtonID::HORN,
+    ButtonID::BACKLIGHT,
+    ButtonID::FAULT_A0,
+    ButtonID::FAULT_A1,
+    ButtonID::FAULT_A2,
+};
+
+static const uint8_t EMPTY_KEYBOARD[8] = {};
+
+static HidReports reports;
+static HidPage page;
+
+void setUp() { reports = HidReports(); }
+
+void tearDown() {}
+
+void test_map_matches_expected_usages() { TEST_ASSERT_EQUAL_UINT32(EXPECTED_USAGE_COUNT, BUTTON_HID_MAP.size()); }
+
+void test_press_hold_release_each_button() {
+  for (size_t i = 0; i < EXPECTED_USAGE_COUNT; i++) {
+    const ExpectedUsage& expected = EXPECTED_USAGES[i];
+    setUp();
+
+    // Press
+    TEST_ASSERT_TRUE(updateHidReports(reports, expected.button, true, page));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(expected.page), static_cast<int>(page));
+    if (expected.page == HidPage::CONSUMER) {
+      TEST_ASSERT_EQUAL_UINT16(expected.usage, reports.consumer);
+      TEST_ASSERT_EQUAL_UINT8_ARRAY(EMPTY_KEYBOARD, reports.keyboard, 8);
+    } else {
+      uint8_t keyboard[8] = {0, 0, static_cast<uint8_t>(expected.usage), 0, 0, 0, 0, 0};
+      TEST_ASSERT_EQUAL_UINT16(0, reports.consumer);
+      TEST_ASSERT_EQUAL_UINT8_ARRAY(keyboard, reports.keyboard, 8);
+    }
+
+    // Hold (the press repeated) sends nothing and keeps the reports
+    HidReports held = reports;
+    TEST_ASSERT_FALSE(updateHidReports(reports, expected.button, true, page));
+    TEST_ASSERT_EQUAL_UINT16(held.consumer, reports.consumer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(held.keyboard, reports.keyboard, 8);
+
+    // Release clears the report on the same page
+    TEST_ASSERT_TRUE(updateHidReports(reports, expected.button, false, page));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(expected.page), static_cast<int>(page));
+    TEST_ASSERT_EQUAL_UINT16(0, reports.consumer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(EMPTY_KEYBOARD, reports.keyboard, 8);
+
+    // A second release sends nothing
+    TEST_ASSERT_FALSE(updateHidReports(reports, expected.button, false, page));
+  }
+}
+
+void test_unmapped_buttons_send_nothing() {
+  for (ButtonID button : UNMAPPED_BUTTONS) {
+    TEST_ASSERT_FALSE(updateHidReports(reports, button, true, page));
+    TEST_ASSERT_FALSE(updateHidReports(reports, button, false, page));
+  }
+  TEST_ASSERT_EQUAL_UINT16(0, reports.consumer);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(EMPTY_KEYBOARD, reports.keyboard, 8);
+}
+
+void test_consumer_and_keyboard_are_independent() {
+  // Media key and arrow held together, each lands in its own report
+  TEST_ASSERT_TRUE(updateHidReports(reports, ButtonID::VOLUME_UP, true, page));
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(HidPage::CONSUMER), static_cast<int>(page));
+  TEST_ASSERT_TRUE(updateHidReports(reports, ButtonID::UP, true, page));
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(HidPage::KEYBOARD), static_cast<int>(page));
+
+  uint8_t keyboard[8] = {0, 0, 0x52, 0, 0, 0, 0, 0};
+  TEST_ASSERT_EQUAL_UINT16(0x00E9, reports.consumer);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(keyboard, reports.keyboard, 8);
+
+  // Releasing one leaves the other report alone
+  TEST_ASSERT_TRUE(updateHidReports(reports, ButtonID::VOLUME_UP, false, page));
+  TEST_ASSERT_EQUAL_UINT16(0, reports.consumer);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(keyboard, reports.keyboard, 8);
+  TEST_ASSERT_TRUE(updateHidReports(reports, ButtonID::UP, false, page));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(EMPTY_KEYBOARD, reports.keyboard, 8);
+}
+
+void test_consumer_newest_press_wins() {
+  updateHidReports(reports, ButtonID::VOLUME_UP, true, page);
+  TEST_ASSERT_TRUE(updateHidReports(reports, ButtonID::NEXT_SONG, true, page));
+  TEST_ASSERT_EQUAL_UINT16(0x00B5, reports.consumer);
+
+  // Releasing the older button does not cancel the newer press
+  TEST_ASSERT_FALSE(updateHidReports(reports, ButtonID::VOLUME_UP, false, page));
+  TEST_ASSERT_EQUAL_UINT16(0x00B5, reports.consumer);
+  TEST_ASSERT_TRUE(updateHidReports(reports, ButtonID::NEXT_SONG, false, page));
+  TEST_ASSERT_EQUAL_UINT16(0, reports.consumer);
+}
+
+void test_keyboard_slots() {
+  // Every keyboard button held at once fits in the six key slots
+  updateHidReports(reports, ButtonID::UP, true, page);
+  updateHidReports(reports, ButtonID::DOWN, true, page);
+  updateHidReports(reports, ButtonID::LEFT, true, page);
+  updateHidReports(reports, ButtonID::RIGHT, true, page);
+  updateHidReports(reports, ButtonID::OK, true, page);
+  uint8_t all[8] = {0, 0, 0x52, 0x51, 0x50, 0x4F, 0x28, 0};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(all, reports.keyboard, 8);
+
+  // A release frees its slot and the next press reuses it
+  TEST_ASSERT_TRUE(updateHidReports(reports, ButtonID::DOWN, false, page));
+  uint8_t released[8] = {0, 0, 0x52, 0, 0x50, 0x4F, 0x28, 0};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(released, reports.keyboard, 8);
+  TEST_ASSERT_TRUE(updateHidReports(reports, ButtonID::DOWN, true, page));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(all, reports.keyboard, 8);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_map_matches_expected_usages);
+  RUN_TEST(test_press_hold_release_each_button);
+  RUN_TEST(test_unmapped_buttons_send_nothing);
+  RUN_TEST(test_consumer_and_keyboard_are_independent);
+  RUN_TEST(test_consumer_newest_press_wins);
+  RUN_TEST(test_keyboard_slots);
+  return UNITY_END();
+}
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Rebuild a timeline from a car transceiver black box dump.
+
+Send "dump" over the serial monitor, save the output, then:
+    python3 tools/blackbox.py monitor.log
+"""
+
+import sys
+
+# Must match ButtonID in ../shared/button_id.hpp
+BUTTONS = [
+    "NONE", "MODE", "LEFT", "NEXT_SONG", "OK", "UP", "PREV_SONG", "RETURN",
+    "PHONE", "DOWN", "VOLUME_UP", "ASSISTANT", "RIGHT", "VOLUME_DOWN",
+    "CRUISE_CONTROL", "CANCEL", "CC_PLUS", "CC_MINUS", "RADAR", "LANE_ASSIST",
+    "PADDLE_LEFT", "PADDLE_RIGHT", "HORN", "BACKLIGHT", "FAULT_A0", "FAULT_A1",
+    "FAULT_A2",
+]
+
+# Must match BlackboxRecord in src/blackbox.hpp (kind: name, payload bytes)
+RECORDS = {
+    0: ("TIME", 4),
+    1: ("RECEIVED", 1),
+    2: ("OUTPUT", 1),
+    3: ("CONNECT", 0),
+    4: ("DISCONNECT", 0),
+    5: ("ILLUMINATION", 1),
+    6: ("LINK", 3),
+    7: ("SET", 1),
+}
+
+DELTA_ESCAPE = 15
+
+
+def button(value):
+    index = value & 0x7F
+    name = BUTTONS[index] if index < len(BUTTONS) else str(index)
+    return name + (" released" if value & 0x80 else " pressed")
+
+
+def describe(kind, payload):
+    if kind in (1, 2):
+        return button(payload[0])
+    if kind == 5:
+        source = "pwm" if payload[0] & 0x80 else "on/off"
+        return "level %d (%s)" % (payload[0] & 0x7F, source)
+    if kind == 6:
+        rssi, peer, power = (b - 256 if b > 127 else b for b in payload)
+        return "rssi %d peer %d tx %d dBm" % (rssi, peer, power)
+    if kind == 7:
+        return "sampled %d ms before" % (payload[0] * 10)
+    return ""
+
+
+def decode_sector(data):
+    """Yield (millis, name, detail) for every record in one sector."""
+    time = 0
+    i = 0
+    while i < len(data) and data[i] != 0xFF:
+        kind = data[i] >> 4
+        delta = data[i] & 0x0F
+        i += 1
+
+        if delta == DELTA_ESCAPE:
+            shift = 0
+            extra = 0
+            while True:
+                byte = data[i]
+                i += 1
+                extra |= (byte & 0x7F) << shift
+                shift += 7
+                if not byte & 0x80:
+                    break
+            delta += extra
+
+        if kind not in RECORDS:
+            yield time, "CORRUPT", "kind %d at offset %d" % (kind, i - 1)
+            return
+        name, length = RECORDS[kind]
+        payload = data[i:i + length]
+        i += length
+
+        if kind == 0:
+            time = int.from_bytes(payload, "little")
+            continue
+        time += delta
+        yield time, name, describe(kind, payload)
+
+
+def main():
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+
+    sectors = []
+    for line in source:
+        fields = line.strip().split(",")
+        if len(fields) < 3 or fields[0] != "BBX":
+            continue
+        if fields[1] == "S":
+            sectors.append((int(fields[2]), fields[3], bytearray()))
+        elif fields[1] == "D" and sectors:
+            sectors[-1][2].extend(bytes.fromhex(fields[2]))
+        elif fields[1] == "E":
+            print("# dropped records: %s" % fields[2])
+
+    boot = None
+    for sequence, boot_id, data in sorted(sectors):
+        if boot_id != boot:
+            print("# boot %s" % boot_id)
+            boot = boot_id
+        for time, name, detail in decode_sector(data):
+            print("%10.3f  %-12s %s" % (time / 1000.0, name, detail))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <algorithm>
+
+// Benchmark configuration
+#define BENCH_ITERATIONS 1000
+
+#ifdef ARDUINO
+// CPU cycle counter (CCOUNT register)
+inline uint32_t benchNow() { return ESP.getCycleCount(); }
+#define BENCH_UNIT "cycles"
+#else
+#include <chrono>
+// Host builds have no portable cycle counter, use a monotonic clock instead
+inline uint32_t benchNow() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+#define BENCH_UNIT "ns"
+#endif
+
+static uint32_t benchSamples[BENCH_ITERATIONS];
+
+// Time body() BENCH_ITERATIONS times (setup() runs untimed before each iteration) and print
+// one machine readable line: BENCH,<name>,<iterations>,<min>,<mean>,<max>,<p99>,<unit>
+template <typename Setup, typename Body>
+void runBenchmark(const char* name, Setup setup, Body body) {
+  for (int i = 0; i < BENCH_ITERATIONS; i++) {
+    setup();
+    uint32_t start = benchNow();
+    body();
+    benchSamples[i] = benchNow() - start;
+  }
+
+  uint64_t sum = 0;
+  for (int i = 0; i < BENCH_ITERATIONS; i++) {
+    sum += benchSamples[i];
+  }
+  std::sort(benchSamples, benchSamples + BENCH_ITERATIONS);
+
+  Serial.print("BENCH,");
+  Serial.print(name);
+  Serial.print(",");
+  Serial.print(BENCH_ITERATIONS);
+  Serial.print(",");
+  Serial.print(benchSamples[0]);
+  Serial.print(",");
+  Serial.print((uint32_t)(sum / BENCH_ITERATIONS));
+  Serial.print(",");
+  Serial.print(benchSamples[BENCH_ITERATIONS - 1]);
+  Serial.print(",");
+  Serial.print(benchSamples[BENCH_ITERATIONS * 99 / 100]);
+  Serial.print(",");
+  Serial.println(BENCH_UNIT);
+}
+
+// Measurement overhead, subtract from the other results when comparing small paths
+inline void runOverheadBenchmark() {
+  runBenchmark("overhead", [] {}, [] {});
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+// Button codes on the wheel link, the low 7 bits of every event byte (8th bit set on release).
+// Used by both boards and the generated ladder bands.
+enum class ButtonID : uint8_t {
+  NONE = 0,
+  MODE = 1,
+  LEFT = 2,
+  NEXT_SONG = 3,
+  OK = 4,
+  UP = 5,
+  PREV_SONG = 6,
+  RETURN = 7,
+  PHONE = 8,
+  DOWN = 9,
+  VOLUME_UP = 10,
+  ASSISTANT = 11,
+  RIGHT = 12,
+  VOLUME_DOWN = 13,
+  CRUISE_CONTROL = 14,
+  CANCEL = 15,
+  CC_PLUS = 16,
+  CC_MINUS = 17,
+  RADAR = 18,
+  LANE_ASSIST = 19,
+  PADDLE_LEFT = 20,
+  PADDLE_RIGHT = 21,
+  HORN = 22,
+  BACKLIGHT = 23,  // Receive only
+  FAULT_A0 = 24,   // Wheel ladder channel degraded (8th bit set when recovered)
+  FAULT_A1 = 25,
+  FAULT_A2 = 26,
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Serial console (same on both boards): newline terminated commands looked up in the board's
+// command table, and heap telemetry.
+
+#define CONSOLE_COMMAND_LENGTH 16   // Longer commands are cut short
+#define HEAP_REPORT_INTERVAL 60000  // milliseconds
+
+struct ConsoleCommand {
+  const char* name;
+  void (*run)();
+};
+
+static unsigned long lastHeapReportTime = 0;
+
+// Prints: HEAP,<free bytes>,<minimum free bytes since boot>
+inline void reportHeap() {
+  Serial.print("HEAP,");
+  Serial.print(ESP.getFreeHeap());
+  Serial.print(",");
+  Serial.println(ESP.getMinFreeHeap());
+  lastHeapReportTime = millis();
+}
+
+// Periodic heap report, in between the ones sent on connection changes
+inline void updateHeapReport(unsigned long now) {
+  if (now - lastHeapReportTime >= HEAP_REPORT_INTERVAL) {
+    reportHeap();
+  }
+}
+
+// Read whatever has arrived on Serial and run each complete line that matches a command
+inline void handleSerialCommands(const ConsoleCommand* commands, size_t count) {
+  static char command[CONSOLE_COMMAND_LENGTH];
+  static size_t commandLength = 0;
+
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c != '\n' && c != '\r') {
+      if (commandLength < sizeof(command) - 1) {
+        command[commandLength++] = c;
+      }
+      continue;
+    }
+    command[commandLength] = '\0';
+    commandLength = 0;
+
+    for (size_t i = 0; i < count; i++) {
+      if (strcmp(command, commands[i].name) == 0) {
+        commands[i].run();
+        break;
+      }
+    }
+  }
+}
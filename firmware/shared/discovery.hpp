@@ -0,0 +1,73 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Discovery phase (starts at boot and on every disconnect)
+struct DiscoveryScheduler {
+  unsigned long phaseStart;
+  uint8_t step;
+  bool discovered;
+};
+
+inline void resetDiscovery(DiscoveryScheduler& scheduler, unsigned long now) {
+  scheduler.phaseStart = now;
+  scheduler.step = 0;
+  scheduler.discovered = false;
+}
+
+// Advance to the step for the current time, returns true when the parameters changed.
+// Step tables are per board, each step applies from `after` milliseconds into the phase.
+template <typename Step>
+inline bool updateDiscovery(DiscoveryScheduler& scheduler, const Step* steps, uint8_t count, unsigned long now) {
+  uint8_t step = scheduler.step;
+  while (step + 1 < count && now - scheduler.phaseStart >= steps[step + 1].after) {
+    step++;
+  }
+  if (step != scheduler.step) {
+    scheduler.step = step;
+    return true;
+  }
+  return false;
+}
+
+// Power of two millisecond buckets, bucket 0 is below LATENCY_BUCKET_BASE ms
+#define LATENCY_BUCKETS 12
+#define LATENCY_BUCKET_BASE 64
+
+struct LatencyHistogram {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint16_t buckets[LATENCY_BUCKETS];
+};
+
+inline void recordLatency(LatencyHistogram& histogram, uint32_t ms) {
+  uint8_t bucket = 0;
+  for (uint32_t limit = LATENCY_BUCKET_BASE; ms >= limit && bucket < LATENCY_BUCKETS - 1; limit <<= 1) {
+    bucket++;
+  }
+  histogram.buckets[bucket]++;
+  histogram.min = histogram.count == 0 || ms < histogram.min ? ms : histogram.min;
+  histogram.max = ms > histogram.max ? ms : histogram.max;
+  histogram.sum += ms;
+  histogram.count++;
+}
+
+// Prints: <name>,<count>,<min>,<mean>,<max>,<bucket 0>,...,<bucket N>
+inline void printLatencyHistogram(const char* name, const LatencyHistogram& histogram) {
+  Serial.print(name);
+  Serial.print(",");
+  Serial.print(histogram.count);
+  Serial.print(",");
+  Serial.print(histogram.min);
+  Serial.print(",");
+  Serial.print(histogram.count ? (uint32_t)(histogram.sum / histogram.count) : 0);
+  Serial.print(",");
+  Serial.print(histogram.max);
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    Serial.print(",");
+    Serial.print(histogram.buckets[i]);
+  }
+  Serial.println();
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <esp_bt.h>
+#include <esp_gap_ble_api.h>
+
+#include "protocol.hpp"
+
+// Link quality monitor and TX power control (same on both boards).
+// Each side sends a report [LINK_MARKER, sequence, rssi] at least every LINK_REPORT_INTERVAL,
+// the wheel puts one in front of every notification. Sequence gaps count lost frames, and the
+// rssi field is how strongly the sender hears its peer, which steers the receiver's TX power.
+
+#define LINK_REPORT_INTERVAL 1000  // milliseconds
+#define LINK_ADJUST_INTERVAL 2000  // milliseconds between TX power steps
+#define LINK_SILENT_TIME 3000      // No report from the peer for this long counts as a weak link
+#define LINK_PRINT_INTERVAL 10000  // milliseconds
+#define LINK_RSSI_LOW -75          // dBm, power goes up below this (before losses start)
+#define LINK_RSSI_HIGH -55         // dBm, power goes down above this
+#define LINK_RSSI_UNKNOWN 127
+#define LINK_RSSI_SMOOTHING 4  // Weight of the previous average
+
+// Levels available on the ESP32, S3 and C3 controllers, lowest first
+static const esp_power_level_t LINK_POWER_LEVELS[] = {
+    ESP_PWR_LVL_N12, ESP_PWR_LVL_N9, ESP_PWR_LVL_N6, ESP_PWR_LVL_N3,
+    ESP_PWR_LVL_N0,  ESP_PWR_LVL_P3, ESP_PWR_LVL_P6, ESP_PWR_LVL_P9,
+};
+static const int8_t LINK_POWER_DBM[] = {-12, -9, -6, -3, 0, 3, 6, 9};
+#define LINK_POWER_LEVEL_COUNT 8
+
+struct LinkQuality {
+  uint8_t txSequence;
+  unsigned long lastReport;  // Sent
+  unsigned long lastPeerReport;  // Received
+
+  bool rxStarted;
+  uint8_t rxSequence;
+  uint32_t received;
+  uint32_t lost;
+  uint32_t windowLost;  // Since the last power step
+  int8_t peerRssi;      // How the peer hears us
+
+  int8_t rssi;  // Smoothed local measurement (how we hear the peer)
+  int8_t rssiMin;
+
+  uint8_t powerIndex;
+  unsigned long lastAdjust;
+  unsigned long lastPrint;
+};
+
+static LinkQuality linkQuality = {};
+static portMUX_TYPE linkLock = portMUX_INITIALIZER_UNLOCKED;
+
+static void applyLinkPower(uint8_t index) {
+  for (int handle = ESP_BLE_PWR_TYPE_CONN_HDL0; handle <= ESP_BLE_PWR_TYPE_CONN_HDL8; handle++) {
+    esp_ble_tx_power_set(static_cast<esp_ble_power_type_t>(handle), LINK_POWER_LEVELS[index]);
+  }
+}
+
+// RSSI reads complete asynchronously through the GAP callback
+static void linkGapHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+  if (event != ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT || param->read_rssi_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+    return;
+  }
+  int8_t rssi = param->read_rssi_cmpl.rssi;
+
+  portENTER_CRITICAL(&linkLock);
+  if (linkQuality.rssi == LINK_RSSI_UNKNOWN) {
+    linkQuality.rssi = rssi;
+  } else {
+    linkQuality.rssi = (linkQuality.rssi * (LINK_RSSI_SMOOTHING - 1) + rssi) / LINK_RSSI_SMOOTHING;
+  }
+  if (rssi < linkQuality.rssiMin) {
+    linkQuality.rssiMin = rssi;
+  }
+  portEXIT_CRITICAL(&linkLock);
+}
+
+// Call after BLEDevice::init
+inline void beginLink() { BLEDevice::setCustomGapHandler(linkGapHandler); }
+
+// Start of a connection, power starts at the top and steps down from there
+inline void resetLink() {
+  portENTER_CRITICAL(&linkLock);
+  linkQuality.rxStarted = false;
+  linkQuality.windowLost = 0;
+  linkQuality.peerRssi = LINK_RSSI_UNKNOWN;
+  linkQuality.rssi = LINK_RSSI_UNKNOWN;
+  linkQuality.rssiMin = 0;
+  linkQuality.powerIndex = LINK_POWER_LEVEL_COUNT - 1;
+  linkQuality.lastPeerReport = millis();
+  linkQuality.lastAdjust = millis();
+  portEXIT_CRITICAL(&linkLock);
+  applyLinkPower(linkQuality.powerIndex);
+}
+
+inline void requestLinkRssi(esp_bd_addr_t peer) { esp_ble_gap_read_rssi(peer); }
+
+inline bool linkReportDue(unsigned long now) { return now - linkQuality.lastReport >= LINK_REPORT_INTERVAL; }
+
+// Fill in the report that starts every frame we send
+inline void writeLinkHeader(uint8_t* frame, unsigned long now) {
+  frame[0] = LINK_MARKER;
+  frame[1] = linkQuality.txSequence++;
+  frame[2] = static_cast<uint8_t>(linkQuality.rssi);
+  linkQuality.lastReport = now;
+}
+
+// Consume the peer's report at the start of a frame, returns the header length (0 without one)
+inline size_t receiveLinkReport(const uint8_t* data, size_t length) {
+  if (length < LINK_HEADER_SIZE || data[0] != LINK_MARKER) {
+    return 0;
+  }
+
+  portENTER_CRITICAL(&linkLock);
+  uint8_t gap = data[1] - static_cast<uint8_t>(linkQuality.rxSequence + 1);
+  if (linkQuality.rxStarted && gap < 128) {  // A larger jump means the peer restarted
+    linkQuality.lost += gap;
+    linkQuality.windowLost += gap;
+  }
+  linkQuality.rxStarted = true;
+  linkQuality.rxSequence = data[1];
+  linkQuality.received++;
+  linkQuality.peerRssi = static_cast<int8_t>(data[2]);
+  linkQuality.lastPeerReport = millis();
+  portEXIT_CRITICAL(&linkLock);
+  return LINK_HEADER_SIZE;
+}
+
+// One power step per LINK_ADJUST_INTERVAL: losses, a silent peer or a weak peer RSSI raise the
+// power, a strong peer RSSI lowers it. Returns true when the power changed.
+inline bool updateLinkPower(unsigned long now, bool allowLowering) {
+  if (now - linkQuality.lastAdjust < LINK_ADJUST_INTERVAL) {
+    return false;
+  }
+  linkQuality.lastAdjust = now;
+
+  portENTER_CRITICAL(&linkLock);
+  uint32_t lost = linkQuality.windowLost;
+  linkQuality.windowLost = 0;
+  int8_t peerRssi = linkQuality.peerRssi;
+  bool silent = now - linkQuality.lastPeerReport >= LINK_SILENT_TIME;
+  portEXIT_CRITICAL(&linkLock);
+
+  uint8_t index = linkQuality.powerIndex;
+  if (lost > 0 || silent) {
+    index = min(index + 2, LINK_POWER_LEVEL_COUNT - 1);
+  } else if (peerRssi != LINK_RSSI_UNKNOWN && peerRssi < LINK_RSSI_LOW) {
+    index = min(index + 1, LINK_POWER_LEVEL_COUNT - 1);
+  } else if (!allowLowering) {
+    index = LINK_POWER_LEVEL_COUNT - 1;
+  } else if (peerRssi != LINK_RSSI_UNKNOWN && peerRssi > LINK_RSSI_HIGH && index > 0) {
+    index--;
+  }
+
+  if (index == linkQuality.powerIndex) {
+    return false;
+  }
+  linkQuality.powerIndex = index;
+  applyLinkPower(index);
+  return true;
+}
+
+inline int8_t linkPowerDbm() { return LINK_POWER_DBM[linkQuality.powerIndex]; }
+
+// Prints: LINK,<rssi>,<min rssi>,<peer rssi>,<tx dBm>,<received>,<lost>
+inline void printLink(unsigned long now) {
+  linkQuality.lastPrint = now;
+  Serial.printf("LINK,%d,%d,%d,%d,%u,%u\n", linkQuality.rssi, linkQuality.rssiMin, linkQuality.peerRssi, linkPowerDbm(), linkQuality.received, linkQuality.lost);
+}
+
+inline bool linkPrintDue(unsigned long now) { return now - linkQuality.lastPrint >= LINK_PRINT_INTERVAL; }
@@ -0,0 +1,64 @@
+#pragma once
+
+// Minimal host stand-in for the Arduino core, only what the benchmarked sources use.
+// Timing functions are no-ops so host results show the cost of the logic alone.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+#define A0 1
+#define A1 2
+#define A2 3
+#define D0 1
+#define D1 2
+#define D2 3
+#define D3 4
+#define D4 5
+#define D5 6
+#define D7 8
+#define D8 9
+#define D9 10
+#define D10 11
+#define LED_BUILTIN 21
+
+// Values returned by analogRead/digitalRead, set by the benchmark
+inline uint16_t nativeAnalogValue[64] = {};
+inline int nativeDigitalValue[64] = {};
+
+inline void pinMode(uint8_t /*pin*/, uint8_t /*mode*/) {}
+inline void digitalWrite(uint8_t pin, uint8_t value) { nativeDigitalValue[pin] = value; }
+inline int digitalRead(uint8_t pin) { return nativeDigitalValue[pin]; }
+inline uint16_t analogRead(uint8_t pin) { return nativeAnalogValue[pin]; }
+inline void analogReadResolution(uint8_t /*bits*/) {}
+inline void delay(uint32_t /*ms*/) {}
+inline void delayMicroseconds(uint32_t /*us*/) {}
+inline unsigned long millis() { return 0; }
+inline unsigned long micros() { return 0; }
+
+class NativeSerial {
+ public:
+  void begin(unsigned long /*baud*/) {}
+  void print(const char* value) { printf("%s", value); }
+  void print(const std::string& value) { printf("%s", value.c_str()); }
+  void print(int value) { printf("%d", value); }
+  void print(unsigned int value) { printf("%u", value); }
+  void print(long value) { printf("%ld", value); }
+  void print(unsigned long value) { printf("%lu", value); }
+  template <typename T>
+  void println(T value) {
+    print(value);
+    println();
+  }
+  void println() { printf("\n"); }
+};
+
+inline NativeSerial Serial;
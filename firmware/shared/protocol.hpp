@@ -0,0 +1,13 @@
+#pragma once
+
+// Notification format on the wheel link (same on both boards).
+// [LINK_MARKER, sequence, rssi] link header, then the sets of changes from each sample as
+// [age, button bytes...] split by EVENT_SET_SEPARATOR. Button bytes are ButtonID (button_id.hpp)
+// with the 8th bit set on release.
+
+#define LINK_MARKER 0x00  // ButtonID::NONE, never sent as an event
+#define LINK_HEADER_SIZE 3
+
+#define EVENT_SET_SEPARATOR 0x80  // NONE released, never an event
+#define EVENT_AGE_UNIT 10         // milliseconds, a set's age is how long before the notification it was sampled
+#define EVENT_AGE_MAX 0x7F        // Older sets saturate here (never the separator)
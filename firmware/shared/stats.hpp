@@ -0,0 +1,175 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_system.h>
+
+// Usage statistics per ButtonID, kept in RAM and stored in NVS as a single blob.
+// Writes are coalesced: one blob write per flush interval (only when something changed and the
+// buttons have been quiet for a moment) plus one at restart, so flash wear and stalls stay low.
+// Changes since the last flush are lost on power off.
+// Boards with resistor ladders build with STATS_LADDER_LEVELS to also track detection levels.
+
+#define STATS_NAMESPACE "usage"
+#define STATS_KEY "stats"
+#define STATS_VERSION 1
+#define STATS_BUTTON_COUNT 32
+#define STATS_DURATION_BUCKETS 8     // Press durations, powers of two from STATS_DURATION_BASE
+#define STATS_DURATION_BASE 64       // milliseconds
+#define STATS_LEVEL_WINDOW 64        // The level mean follows drift once it has this many samples
+#define STATS_FLUSH_INTERVAL 600000  // milliseconds
+#define STATS_QUIET_TIME 2000        // Flushes wait for this long without button changes
+
+struct ButtonStats {
+  uint32_t presses;  // Degradations for the FAULT ids
+  uint32_t heldTime;  // Total milliseconds
+  uint16_t durations[STATS_DURATION_BUCKETS];
+#ifdef STATS_LADDER_LEVELS
+  uint16_t levelSamples;
+  float levelMean;  // Averaged ADC code at detection, ladder buttons only
+#endif
+};
+
+struct UsageStats {
+  uint32_t version;
+  uint32_t flushes;
+  ButtonStats buttons[STATS_BUTTON_COUNT];
+};
+
+static UsageStats usageStats;
+static UsageStats statsSnapshot;  // Copy being written, keeps the lock short
+static unsigned long statsPressTime[STATS_BUTTON_COUNT];
+static uint32_t statsHeld = 0;
+static bool statsDirty = false;
+static unsigned long statsLastChange = 0;
+static unsigned long statsLastFlush = 0;
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+static Preferences statsStore;
+static bool statsOpen = false;
+
+// Count a press or release (button byte, 8th bit set on release)
+inline void recordStatsChange(uint8_t value, unsigned long time) {
+  uint8_t id = value & 0x7F;
+  if (id >= STATS_BUTTON_COUNT) {
+    return;
+  }
+  ButtonStats& stats = usageStats.buttons[id];
+
+  portENTER_CRITICAL(&statsLock);
+  if ((value & 0x80) == 0) {
+    stats.presses++;
+    statsPressTime[id] = time;
+    statsHeld |= 1UL << id;
+  } else if (statsHeld & (1UL << id)) {
+    uint32_t held = time - statsPressTime[id];
+    uint8_t bucket = 0;
+    for (uint32_t limit = STATS_DURATION_BASE; held >= limit && bucket < STATS_DURATION_BUCKETS - 1; limit <<= 1) {
+      bucket++;
+    }
+    if (stats.durations[bucket] < UINT16_MAX) {
+      stats.durations[bucket]++;
+    }
+    stats.heldTime += held;
+    statsHeld &= ~(1UL << id);
+  }
+  statsDirty = true;
+  statsLastChange = time;
+  portEXIT_CRITICAL(&statsLock);
+}
+
+#ifdef STATS_LADDER_LEVELS
+// Running mean of the ladder level a button was detected at (drifting means a worn switch)
+void recordStatsLevel(uint8_t id, uint16_t level) {
+  if (id >= STATS_BUTTON_COUNT) {
+    return;
+  }
+  ButtonStats& stats = usageStats.buttons[id];
+
+  portENTER_CRITICAL(&statsLock);
+  if (stats.levelSamples < STATS_LEVEL_WINDOW) {
+    stats.levelSamples++;
+  }
+  stats.levelMean += (level - stats.levelMean) / stats.levelSamples;
+  statsDirty = true;
+  portEXIT_CRITICAL(&statsLock);
+}
+#endif
+
+static void saveStats() {
+  if (!statsOpen) {
+    return;
+  }
+  portENTER_CRITICAL(&statsLock);
+  usageStats.flushes++;
+  statsSnapshot = usageStats;
+  statsDirty = false;
+  portEXIT_CRITICAL(&statsLock);
+
+  statsStore.putBytes(STATS_KEY, &statsSnapshot, sizeof(statsSnapshot));
+  statsLastFlush = millis();
+}
+
+// Restarts (error recovery, uploads) keep everything recorded so far
+static void saveStatsOnShutdown() {
+  if (statsDirty) {
+    saveStats();
+  }
+}
+
+inline void beginStats() {
+  statsOpen = statsStore.begin(STATS_NAMESPACE, false);
+  if (!statsOpen) {
+    Serial.println("Stats storage unavailable, counting in RAM only");
+    return;
+  }
+
+  if (statsStore.getBytesLength(STATS_KEY) != sizeof(usageStats) || statsStore.getBytes(STATS_KEY, &usageStats, sizeof(usageStats)) != sizeof(usageStats) || usageStats.version != STATS_VERSION) {
+    memset(&usageStats, 0, sizeof(usageStats));  // Missing or from an older layout
+    usageStats.version = STATS_VERSION;
+  }
+  esp_register_shutdown_handler(saveStatsOnShutdown);
+}
+
+// Call periodically, writes only when the flush interval has passed and the buttons are quiet
+inline void updateStats(unsigned long now) {
+  if (statsDirty && now - statsLastFlush >= STATS_FLUSH_INTERVAL && now - statsLastChange >= STATS_QUIET_TIME) {
+    saveStats();
+  }
+}
+
+// Prints: STATS,<id>,<presses>,<held ms>[,<mean level>],<bucket 0>,...,<bucket N> for every used
+// button (the level only with STATS_LADDER_LEVELS), then STATS,E,<flushes>
+inline void printStats() {
+  portENTER_CRITICAL(&statsLock);
+  statsSnapshot = usageStats;
+  portEXIT_CRITICAL(&statsLock);
+
+  for (uint8_t id = 0; id < STATS_BUTTON_COUNT; id++) {
+    const ButtonStats& stats = statsSnapshot.buttons[id];
+#ifdef STATS_LADDER_LEVELS
+    if (stats.presses == 0 && stats.levelSamples == 0) {
+      continue;
+    }
+    Serial.printf("STATS,%u,%u,%u,%u", id, stats.presses, stats.heldTime, (unsigned)(stats.levelMean + 0.5f));
+#else
+    if (stats.presses == 0) {
+      continue;
+    }
+    Serial.printf("STATS,%u,%u,%u", id, stats.presses, stats.heldTime);
+#endif
+    for (int i = 0; i < STATS_DURATION_BUCKETS; i++) {
+      Serial.printf(",%u", stats.durations[i]);
+    }
+    Serial.println();
+  }
+  Serial.printf("STATS,E,%u\n", statsSnapshot.flushes);
+}
+
+// Start counting from zero (written straight away)
+inline void clearStats() {
+  portENTER_CRITICAL(&statsLock);
+  memset(usageStats.buttons, 0, sizeof(usageStats.buttons));
+  usageStats.flushes = 0;
+  portEXIT_CRITICAL(&statsLock);
+  saveStats();
+}
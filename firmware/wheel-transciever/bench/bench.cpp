@@ -0,0 +1,48 @@
+#include <Arduino.h>
+
+#include "../src/buttons.hpp"
+#include "bench.hpp"
+
+// Keeps results observable so the compiler can't drop the benchmarked calls
+static volatile uint8_t benchSink;
+
+// No BLE link in the benchmark build, measures the state tracking only
+void sendButtonChanges(const uint8_t* values, size_t /*count*/) { benchSink = values[0]; }
+void recordStatsLevel(uint8_t id, uint16_t /*level*/) { benchSink = id; }
+
+void runBenchmarks() {
+  runOverheadBenchmark();
+
+  runBenchmark("getLadder", [] { ladderA0.waitingForReset = false; }, [] { benchSink = static_cast<uint8_t>(getLadder(ladderA0, ButtonID::NONE)); });
+
+  runBenchmark("getAveragedADCReading", [] {}, [] { benchSink = getAveragedADCReading(PIN_A0); });
+
+  runBenchmark("handleButtonIDStateChange", [] { inputState.a0 = ButtonID::OK; sampleChanges.count = 0; }, [] { handleButtonIDStateChange(ButtonID::UP, inputState.a0); });
+
+  Serial.println("BENCH,done");
+}
+
+#ifdef ARDUINO
+void setup() {
+  Serial.begin(115200);
+  analogReadResolution(12);
+  pinMode(PIN_A0, INPUT);
+  pinMode(PIN_A1, INPUT);
+  pinMode(PIN_A2, INPUT);
+
+  delay(2000);  // Give the serial monitor time to attach
+  runBenchmarks();
+}
+
+void loop() { delay(1000); }
+#else
+int main() {
+  // Simulate VOLUME_UP held on the A0 ladder so the full decode path runs, the others rest low
+  nativeAnalogValue[PIN_A0] = 674;
+  nativeAnalogValue[PIN_A1] = 0;
+  nativeAnalogValue[PIN_A2] = 0;
+
+  runBenchmarks();
+  return 0;
+}
+#endif
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "button_id.hpp"
+#include "health.hpp"
+
+// Pin Definitions and ADC Configuration
+#define ADC_VERIFY_READ_DELAY 100  // microseconds
+#define ADC_VERIFY_READ_RANGE 50
+// Average
+#define ADC_AVERAGE_SAMPLES 100
+#define ADC_SAMPLE_DELAY_US 50
+
+// Pins on the wheel transceiver (hardware/wheel-transceiver). The ladders have pull-downs and
+// rest low, the horn and paddles have pull-ups and read low while pressed.
+#define PIN_A0 A0
+#define PIN_A1 A1
+#define PIN_A2 A2
+#define PIN_HORN D8
+#define PIN_PADDLE_RIGHT D9
+#define PIN_PADDLE_LEFT D10
+
+// Everything held after the last sample (each ladder holds at most one button)
+struct InputState {
+  ButtonID a0;
+  ButtonID a1;
+  ButtonID a2;
+  bool horn;
+  bool paddleRight;
+  bool paddleLeft;
+};
+
+// Changes found in one sample, sent to the car together with one timestamp. Worst case is every
+// ladder switching directly between buttons (release and press), every switch changing and every
+// ladder reporting a fault; one set of that size plus its age byte still fits a notification.
+#define INPUT_LADDER_COUNT 3
+#define INPUT_SWITCH_COUNT 3
+#define INPUT_CHANGE_MAX (INPUT_LADDER_COUNT * 2 + INPUT_SWITCH_COUNT + INPUT_LADDER_COUNT)
+struct InputChanges {
+  uint8_t count;
+  uint8_t values[INPUT_CHANGE_MAX];  // ButtonID, 8th bit set on release
+};
+
+// One resistor ladder, decoded with the bands generated from the schematics (thresholds.hpp)
+struct LadderChannel {
+  uint8_t pin;
+  ButtonID fault;
+  LadderMonitor health;
+  bool waitingForReset;  // Analog reset (prevents noise in some cases)
+  ButtonID candidate;    // Another button seen on a latched ladder, switched to when the next sample agrees (NONE if none)
+};
+
+// Button State Variables
+InputState inputState = {ButtonID::NONE, ButtonID::NONE, ButtonID::NONE, false, false, false};
+InputChanges sampleChanges;
+
+LadderChannel ladderA0 = {PIN_A0, ButtonID::FAULT_A0, {LadderThreshold::A0_RESTING_HIGH, LadderThreshold::A0_BANDS, LadderThreshold::A0_BAND_COUNT, ChannelHealth::OK, false, false, 0, 0, 0, 0, 0}, false, ButtonID::NONE};
+LadderChannel ladderA1 = {PIN_A1, ButtonID::FAULT_A1, {LadderThreshold::A1_RESTING_HIGH, LadderThreshold::A1_BANDS, LadderThreshold::A1_BAND_COUNT, ChannelHealth::OK, false, false, 0, 0, 0, 0, 0}, false, ButtonID::NONE};
+LadderChannel ladderA2 = {PIN_A2, ButtonID::FAULT_A2, {LadderThreshold::A2_RESTING_HIGH, LadderThreshold::A2_BANDS, LadderThreshold::A2_BAND_COUNT, ChannelHealth::OK, false, false, 0, 0, 0, 0, 0}, false, ButtonID::NONE};
+
+// Sends the changes from one sample to the car (defined by the link layer)
+void sendButtonChanges(const uint8_t* values, size_t count);
+// Ladder level a button was detected at (defined by the usage statistics)
+void recordStatsLevel(uint8_t id, uint16_t level);
+
+void addInputChange(uint8_t value) {
+  if (sampleChanges.count < INPUT_CHANGE_MAX) {
+    sampleChanges.values[sampleChanges.count++] = value;
+  }
+}
+
+// Report a channel fault or recovery to the car
+void reportLadderHealth(const LadderChannel& ladder) {
+  uint8_t value = static_cast<uint8_t>(ladder.fault);
+  if (!ladderDegraded(ladder.health)) {
+    value |= 0x80;  // recovered
+  }
+  addInputChange(value);
+
+  Serial.print("Ladder A");
+  Serial.print(static_cast<int>(ladder.fault) - static_cast<int>(ButtonID::FAULT_A0));
+  Serial.print(" health ");
+  Serial.println(static_cast<int>(ladder.health.health));
+}
+
+// Returns true while the channel is degraded (reporting NONE releases any held button)
+bool checkLadderHealth(LadderChannel& ladder, uint16_t value) {
+  if (updateLadderHealth(ladder.health, value, millis())) {
+    reportLadderHealth(ladder);
+  }
+  if (ladderDegraded(ladder.health)) {
+    ladder.waitingForReset = false;
+    return true;
+  }
+  return false;
+}
+
+bool confirmADCReading(int pin, int firstReading) {
+  delayMicroseconds(ADC_VERIFY_READ_DELAY);
+  int secondReading = analogRead(pin);
+  return abs(secondReading - firstReading) <= ADC_VERIFY_READ_RANGE;
+}
+
+uint16_t getAveragedADCReading(int pin) {
+  uint32_t sum = 0;
+  for (int i = 0; i < ADC_AVERAGE_SAMPLES; i++) {
+    sum += analogRead(pin);
+    delayMicroseconds(ADC_SAMPLE_DELAY_US);
+  }
+  return sum / ADC_AVERAGE_SAMPLES;
+}
+
+// Button for a level above resting, NONE between the bands
+ButtonID decodeLadderLevel(const LadderChannel& ladder, uint16_t value) { return decodeLadder(ladder.health.bands, ladder.health.bandCount, value); }
+
+// Button held on a ladder after this sample, `held` is the one reported after the last sample
+ButtonID getLadder(LadderChannel& ladder, ButtonID held) {
+  uint16_t value = analogRead(ladder.pin);
+
+  // Degraded channels report no button until they recover
+  if (checkLadderHealth(ladder, value)) {
+    return ButtonID::NONE;
+  }
+
+  // If waiting for reset, check if value has returned to the resting level
+  if (ladder.waitingForReset) {
+    if (value <= ladder.health.restingHigh) {
+      ladder.waitingForReset = false;
+      ladder.candidate = ButtonID::NONE;
+      return ButtonID::NONE;
+    }
+
+    // Direct change to another button without passing through resting. A level between bands
+    // is never a transition, only the resting level releases the held button.
+    ButtonID seen = decodeLadderLevel(ladder, value);
+    if (seen != held && seen != ButtonID::NONE && confirmADCReading(ladder.pin, value)) {
+      value = getAveragedADCReading(ladder.pin);
+      ButtonID direct = decodeLadderLevel(ladder, value);
+      if (direct == held || direct == ButtonID::NONE) {
+        ladder.candidate = ButtonID::NONE;
+      } else if (direct == ladder.candidate) {
+        recordStatsLevel(static_cast<uint8_t>(direct), value);
+        ladder.candidate = ButtonID::NONE;
+        return direct;
+      } else {
+        ladder.candidate = direct;
+      }
+    } else {
+      ladder.candidate = ButtonID::NONE;
+    }
+    return held;
+  }
+
+  // Check if the ladder is above its resting level
+  if (value > ladder.health.restingHigh) {
+    if (confirmADCReading(ladder.pin, value)) {
+      // Get averaged reading
+      value = getAveragedADCReading(ladder.pin);
+      ButtonID result = decodeLadderLevel(ladder, value);
+
+      if (result != ButtonID::NONE) {
+        recordStatsLevel(static_cast<uint8_t>(result), value);
+        ladder.waitingForReset = true;
+        ladder.candidate = ButtonID::NONE;
+        return result;
+      }
+    }
+  }
+
+  return ButtonID::NONE;
+}
+
+bool getHorn() { return digitalRead(PIN_HORN) == LOW; }
+
+bool getPaddleR() { return digitalRead(PIN_PADDLE_RIGHT) == LOW; }
+
+bool getPaddleL() { return digitalRead(PIN_PADDLE_LEFT) == LOW; }
+
+void handleButtonStateChange(bool currentState, bool& previousState, ButtonID buttonId) {
+  if (currentState != previousState) {
+    uint8_t value = static_cast<uint8_t>(buttonId);
+    if (previousState) {
+      value |= 0x80;  // off flag
+    }
+    if (currentState || previousState) {  // only send if there's a change to report
+      addInputChange(value);
+    }
+    previousState = currentState;
+  }
+}
+
+void handleButtonIDStateChange(ButtonID currentButton, ButtonID& previousButton) {
+  if (currentButton != previousButton) {
+    if (previousButton != ButtonID::NONE) {
+      uint8_t value = static_cast<uint8_t>(previousButton) | 0x80;  // off flag
+      addInputChange(value);
+    }
+    if (currentButton != ButtonID::NONE) {
+      uint8_t value = static_cast<uint8_t>(currentButton);
+      addInputChange(value);
+    }
+    previousButton = currentButton;
+  }
+}
+
+// Releases go first so the car never sees a chord that wasn't held
+void orderInputChanges(InputChanges& changes) {
+  for (uint8_t i = 1; i < changes.count; i++) {
+    uint8_t value = changes.values[i];
+    uint8_t j = i;
+    while (j > 0 && (value & 0x80) && !(changes.values[j - 1] & 0x80)) {
+      changes.values[j] = changes.values[j - 1];
+      j--;
+    }
+    changes.values[j] = value;
+  }
+}
+
+// Sample every input once, all changes go to sendButtonChanges as one set
+void sampleInputs() {
+  sampleChanges.count = 0;
+
+  InputState current;
+  current.a0 = getLadder(ladderA0, inputState.a0);
+  current.a1 = getLadder(ladderA1, inputState.a1);
+  current.a2 = getLadder(ladderA2, inputState.a2);
+  current.horn = getHorn();
+  current.paddleRight = getPaddleR();
+  current.paddleLeft = getPaddleL();
+
+  handleButtonIDStateChange(current.a0, inputState.a0);
+  handleButtonIDStateChange(current.a1, inputState.a1);
+  handleButtonIDStateChange(current.a2, inputState.a2);
+  handleButtonStateChange(current.horn, inputState.horn, ButtonID::HORN);
+  handleButtonStateChange(current.paddleRight, inputState.paddleRight, ButtonID::PADDLE_RIGHT);
+  handleButtonStateChange(current.paddleLeft, inputState.paddleLeft, ButtonID::PADDLE_LEFT);
+
+  if (sampleChanges.count > 0) {
+    orderInputChanges(sampleChanges);
+    sendButtonChanges(sampleChanges.values, sampleChanges.count);
+  }
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "buttons.hpp"
+#include "protocol.hpp"
+#include "stats.hpp"
+
+// Input sampling (runs from the start of setup(), independent of the BLE link)
+#define INPUT_SAMPLE_PERIOD 100  // milliseconds
+#define INPUT_TASK_PRIORITY 2
+#define INPUT_TASK_STACK 4096
+
+// Event queue and replay
+#define EVENT_QUEUE_LENGTH 32
+#define EVENT_BATCH_SIZE 17           // Event bytes per notification (20 byte ATT payload less the link header)
+#define REPLAY_FRESH_AGE 500          // Events younger than this are always sent
+#define REPLAY_EXPIRY_MEDIA 1500      // Presses queued before the link came up
+#define REPLAY_EXPIRY_HELD 0          // Only replayed if the button is still held
+#define REPLAY_EXPIRY_ALWAYS 0xFFFFFFFFUL
+
+#define BUTTON_ID_COUNT 32
+
+// Every change found in one sample, queued as one item so the set is never split
+struct ButtonEvent {
+  unsigned long time;
+  uint8_t count;
+  uint8_t values[INPUT_CHANGE_MAX];  // ButtonID, 8th bit set on release
+};
+
+static QueueHandle_t eventQueue = nullptr;
+static TaskHandle_t inputTask = nullptr;
+
+// Latest state seen by the sampler, and the state last sent to the car
+static volatile bool inputHeld[BUTTON_ID_COUNT];
+static bool sentPressed[BUTTON_ID_COUNT];
+
+// Boot timing
+static unsigned long bootFirstSample = 0;
+static unsigned long bootLink = 0;
+
+// How long a press may wait for the link before it is stale
+inline unsigned long replayExpiry(ButtonID button) {
+  switch (button) {
+    case ButtonID::HORN:
+    case ButtonID::PADDLE_LEFT:
+    case ButtonID::PADDLE_RIGHT:
+      return REPLAY_EXPIRY_HELD;
+    case ButtonID::FAULT_A0:
+    case ButtonID::FAULT_A1:
+    case ButtonID::FAULT_A2:
+      return REPLAY_EXPIRY_ALWAYS;
+    default:
+      return REPLAY_EXPIRY_MEDIA;
+  }
+}
+
+// Called by the sampler task with the changes from one sample, queues instead of notifying
+void sendButtonChanges(const uint8_t* values, size_t count) {
+  ButtonEvent event;
+  event.time = millis();
+  event.count = count;
+  memcpy(event.values, values, count);
+  for (size_t i = 0; i < count; i++) {
+    inputHeld[values[i] & 0x7F] = (values[i] & 0x80) == 0;
+    recordStatsChange(values[i], event.time);
+  }
+
+  // Keep the newest events when the link has been down for a while
+  if (xQueueSend(eventQueue, &event, 0) != pdTRUE) {
+    ButtonEvent oldest;
+    xQueueReceive(eventQueue, &oldest, 0);
+    xQueueSend(eventQueue, &event, 0);
+  }
+}
+
+static void inputSampleTask(void* parameter) {
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    sampleInputs();
+    if (bootFirstSample == 0) {
+      bootFirstSample = millis();
+    }
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(INPUT_SAMPLE_PERIOD));
+  }
+}
+
+// Start sampling, safe to call again when BLE is reinitialised
+inline void beginInputSampling() {
+  if (inputTask != nullptr) {
+    return;
+  }
+  eventQueue = xQueueCreate(EVENT_QUEUE_LENGTH, sizeof(ButtonEvent));
+  xTaskCreate(inputSampleTask, "input", INPUT_TASK_STACK, nullptr, INPUT_TASK_PRIORITY, &inputTask);
+}
+
+// Block until an event is queued (or the timeout passes)
+inline void waitForButtonEvent(unsigned long timeout) {
+  ButtonEvent event;
+  xQueuePeek(eventQueue, &event, pdMS_TO_TICKS(timeout));
+}
+
+// Events taken off the queue whose notification has not been sent yet (retried on the next flush).
+// One notification holds at most (EVENT_BATCH_SIZE + 1) / 3 sets, plus room for one more.
+#define EVENT_PENDING_MAX ((EVENT_BATCH_SIZE + 1) / 3 + 1)
+static ButtonEvent pendingEvents[EVENT_PENDING_MAX];
+static uint8_t pendingCount = 0;
+
+// Batch length once a set of setLength changes (with its separator and age) is added
+inline size_t batchLengthWith(size_t length, size_t setLength) { return (length > 0 ? length + 1 : 0) + 1 + setLength; }
+
+inline bool batchHasRoom(size_t length, size_t setLength) { return batchLengthWith(length, setLength) <= EVENT_BATCH_SIZE; }
+
+// Age byte for a set sampled `age` milliseconds before the notification
+inline uint8_t eventAge(unsigned long age) { return age / EVENT_AGE_UNIT < EVENT_AGE_MAX ? age / EVENT_AGE_UNIT : EVENT_AGE_MAX; }
+
+// Append one set to the batch, sets never straddle two notifications
+inline void batchButtonSet(uint8_t* batch, size_t& length, uint8_t age, const uint8_t* set, size_t setLength) {
+  if (setLength == 0) {
+    return;
+  }
+  if (length > 0) {
+    batch[length++] = EVENT_SET_SEPARATOR;
+  }
+  batch[length++] = age;
+  memcpy(batch + length, set, setLength);
+  length += setLength;
+}
+
+// Add what is left of one sample set after the replay filter. Stale presses are dropped (with
+// their releases), `pressed` is the car's view once the batch has been sent.
+inline void batchButtonEvent(const ButtonEvent& event, unsigned long now, bool* pressed, uint8_t* batch, size_t& length) {
+  uint8_t set[INPUT_CHANGE_MAX];
+  size_t setLength = 0;
+  unsigned long age = now - event.time;
+
+  for (uint8_t i = 0; i < event.count; i++) {
+    uint8_t id = event.values[i] & 0x7F;
+    if ((event.values[i] & 0x80) == 0) {
+      unsigned long expiry = replayExpiry(static_cast<ButtonID>(id));
+      if (age > REPLAY_FRESH_AGE && age > expiry && !inputHeld[id]) {
+        continue;
+      }
+      pressed[id] = true;
+    } else {
+      if (!pressed[id]) {
+        continue;
+      }
+      pressed[id] = false;
+    }
+    set[setLength++] = event.values[i];
+  }
+  batchButtonSet(batch, length, eventAge(age), set, setLength);
+}
+
+// Drain the queue into batched notifications, one set per sample, each stamped with how long ago
+// it was sampled (the car subtracts that from its arrival time). Any button the car still thinks
+// is held but has since been let go is released, so a backlog never leaves an output stuck.
+// send() returns false when the notification did not go out; the events are then kept and retried
+// by the next call. Returns true once everything has been sent.
+template <typename Send>
+bool flushButtonEvents(Send send) {
+  unsigned long now = millis();
+  uint8_t batch[EVENT_BATCH_SIZE];
+  size_t length;
+  bool pressed[BUTTON_ID_COUNT];
+
+  for (;;) {
+    length = 0;
+    memcpy(pressed, sentPressed, sizeof(pressed));
+
+    // Room is reserved for the unfiltered sets, so the batch can never overflow
+    size_t reserved = 0;
+    uint8_t batched = 0;
+    while (batched < pendingCount && batchHasRoom(reserved, pendingEvents[batched].count)) {
+      reserved = batchLengthWith(reserved, pendingEvents[batched].count);
+      batchButtonEvent(pendingEvents[batched++], now, pressed, batch, length);
+    }
+
+    ButtonEvent event;
+    while (batched == pendingCount && pendingCount < EVENT_PENDING_MAX && xQueuePeek(eventQueue, &event, 0) == pdTRUE && batchHasRoom(reserved, event.count)) {
+      xQueueReceive(eventQueue, &event, 0);  // The sampler may have dropped the peeked event meanwhile
+      pendingEvents[pendingCount++] = event;
+      if (batchHasRoom(reserved, event.count)) {
+        reserved = batchLengthWith(reserved, event.count);
+        batchButtonEvent(pendingEvents[batched++], now, pressed, batch, length);
+      }
+    }
+
+    if (batched == 0) {
+      break;
+    }
+    if (length > 0 && !send(batch, length)) {
+      return false;
+    }
+    memcpy(sentPressed, pressed, sizeof(sentPressed));
+    pendingCount -= batched;
+    memmove(pendingEvents, pendingEvents + batched, pendingCount * sizeof(ButtonEvent));
+  }
+
+  uint8_t set[EVENT_BATCH_SIZE - 1];
+  size_t setLength = 0;
+  memcpy(pressed, sentPressed, sizeof(pressed));
+  for (uint8_t id = 0; id < BUTTON_ID_COUNT && setLength < sizeof(set); id++) {
+    if (pressed[id] && !inputHeld[id]) {
+      set[setLength++] = id | 0x80;
+      pressed[id] = false;
+    }
+  }
+  if (setLength > 0) {
+    length = 0;
+    batchButtonSet(batch, length, 0, set, setLength);  // Released as of now
+    if (!send(batch, length)) {
+      return false;
+    }
+    memcpy(sentPressed, pressed, sizeof(sentPressed));
+  }
+  return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "thresholds.hpp"
+
+// Ladder fault detection (all times in milliseconds)
+#define LADDER_STUCK_PRESSED_TIMEOUT 15000  // Above resting for longer than any real press
+#define LADDER_OUT_OF_BAND_TIMEOUT 500      // Above resting but in no button band
+#define LADDER_FLAP_WINDOW 2000
+#define LADDER_FLAP_LIMIT 16                // Press/release transitions within the window
+#define LADDER_RECOVERY_TIME 2000           // Continuous resting level before a degraded channel is trusted again
+
+enum class ChannelHealth : uint8_t {
+  OK = 0,
+  STUCK_PRESSED = 1,
+  OUT_OF_BAND = 2,
+  FLAPPING = 3,
+};
+
+// Health monitor for one resistor ladder channel. Only depends on the raw reading, the bands
+// and a timestamp, so it can be fed synthetic traces as well as analogRead().
+struct LadderMonitor {
+  uint16_t restingHigh;     // Readings at or below this are the resting level (pull-down)
+  const LadderBand* bands;  // Readings above resting outside every band match no button
+  size_t bandCount;
+
+  ChannelHealth health;
+  bool pressed;
+  bool outOfBand;
+  unsigned long pressedSince;
+  unsigned long outOfBandSince;
+  unsigned long restingSince;
+  unsigned long flapWindowStart;
+  uint8_t transitions;
+};
+
+inline bool ladderDegraded(const LadderMonitor& monitor) { return monitor.health != ChannelHealth::OK; }
+
+// Feed one reading, returns true when the channel health changed
+inline bool updateLadderHealth(LadderMonitor& monitor, uint16_t value, unsigned long now) {
+  bool pressed = value > monitor.restingHigh;
+  bool outOfBand = pressed && decodeLadder(monitor.bands, monitor.bandCount, value) == ButtonID::NONE;
+
+  // Track how long the signal has been in each region
+  if (pressed != monitor.pressed) {
+    monitor.pressed = pressed;
+    monitor.pressedSince = now;
+    monitor.restingSince = now;
+
+    // A window opens at the first transition after the previous one expired
+    if (monitor.transitions == 0 || now - monitor.flapWindowStart > LADDER_FLAP_WINDOW) {
+      monitor.flapWindowStart = now;
+      monitor.transitions = 0;
+    }
+    monitor.transitions++;
+  }
+  if (outOfBand != monitor.outOfBand) {
+    monitor.outOfBand = outOfBand;
+    monitor.outOfBandSince = now;
+  }
+
+  ChannelHealth previous = monitor.health;
+
+  if (monitor.health == ChannelHealth::OK) {
+    if (monitor.pressed && now - monitor.pressedSince >= LADDER_STUCK_PRESSED_TIMEOUT) {
+      monitor.health = ChannelHealth::STUCK_PRESSED;
+    } else if (monitor.outOfBand && now - monitor.outOfBandSince >= LADDER_OUT_OF_BAND_TIMEOUT) {
+      monitor.health = ChannelHealth::OUT_OF_BAND;
+    } else if (monitor.transitions >= LADDER_FLAP_LIMIT) {
+      monitor.health = ChannelHealth::FLAPPING;
+    }
+  } else if (!monitor.pressed && now - monitor.restingSince >= LADDER_RECOVERY_TIME) {
+    // Recover only after the signal has settled at the resting level
+    monitor.health = ChannelHealth::OK;
+    monitor.transitions = 0;
+    monitor.flapWindowStart = now;
+  }
+
+  return monitor.health != previous;
+}
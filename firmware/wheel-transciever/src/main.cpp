@@ -5,111 +5,68 @@
 #include <BLEServer.h>
 #include <BLEUtils.h>
 
+#include "buttons.hpp"
+#include "console.hpp"
+#include "discovery.hpp"
+#include "events.hpp"
+#include "link.hpp"
+#include "stats.hpp"
+
 // BLE Configuration
 #define SERVICE_UUID "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
 #define CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a8"
-#define ADVERTISING_INTERVAL 2000  // Increased to 2 seconds
-
-// Pin Definitions and ADC Configuration
-#define ADC_VERIFY_READ_DELAY 100  // microseconds
-#define ADC_VERIFY_READ_RANGE 50
-// Average
-#define ADC_AVERAGE_SAMPLES 100
-#define ADC_SAMPLE_DELAY_US 50
-
-#define PIN_A0 A0
-#define PIN_A1 A1
-#define PIN_HORN D2
-#define PIN_PADDLE_RIGHT D3
-#define PIN_PADDLE_LEFT D4
-#define PIN_BACKLIGHT D5
+
+#define PIN_BACKLIGHT D7  // Drives the backlight transistor
+
+// Backlight PWM (brightness forwarded from the car's dimmer)
+#define BACKLIGHT_PWM_CHANNEL 0
+#define BACKLIGHT_PWM_FREQ 5000
+#define BACKLIGHT_PWM_RESOLUTION 8
+
+// Advertising backoff step, parameters apply from `after` milliseconds into the discovery phase
+struct AdvertisingStep {
+  unsigned long after;
+  uint16_t minInterval;  // 0.625ms units
+  uint16_t maxInterval;  // 0.625ms units
+};
+
+// Fast advertising right after boot or a disconnect, then exponential backoff (each step
+// lasts twice as long as the one before)
+const AdvertisingStep ADVERTISING_STEPS[] = {
+    {0, 32, 48},          // 0-10s, 20-30ms
+    {10000, 160, 240},    // 10-30s, 100-150ms
+    {30000, 400, 600},    // 30-70s, 250-375ms
+    {70000, 1600, 2400},  // From 70s, 1-1.5s
+};
+const uint8_t ADVERTISING_STEP_COUNT = sizeof(ADVERTISING_STEPS) / sizeof(ADVERTISING_STEPS[0]);
 
 // BLE Variables
 BLEServer* pServer = NULL;
 BLECharacteristic* pCharacteristic = NULL;
 bool deviceConnected = false;
 bool oldDeviceConnected = false;
-unsigned long lastAdvertisingTime = 0;
+DiscoveryScheduler advertisingScheduler;
+LatencyHistogram timeToConnect;
 unsigned long lastBacklightToggleTime = 0;
 bool backlightState = false;
 unsigned long errorCount = 0;
 const unsigned long ERROR_THRESHOLD = 5;
+esp_bd_addr_t carAddress;
+static BLE2902 buttonDescriptor;  // Notifications stay off until the car writes the CCCD
+volatile bool notifySent = false;
 
-enum class ButtonID : uint8_t {
-  NONE = 0,
-  MODE = 1,
-  LEFT = 2,
-  NEXT_SONG = 3,
-  OK = 4,
-  UP = 5,
-  PREV_SONG = 6,
-  RETURN = 7,
-  PHONE = 8,
-  DOWN = 9,
-  VOLUME_UP = 10,
-  ASSISTANT = 11,
-  RIGHT = 12,
-  VOLUME_DOWN = 13,
-  CRUISE_CONTROL = 14,
-  CANCEL = 15,
-  CC_PLUS = 16,
-  CC_MINUS = 17,
-  RADAR = 18,
-  LANE_ASSIST = 19,
-  PADDLE_LEFT = 20,
-  PADDLE_RIGHT = 21,
-  HORN = 22,
-  BACKLIGHT = 23,  // Receive only
-};
-
-namespace Threshold {
-// Resting state values
-constexpr uint16_t A0_RESTING = 3500;
-constexpr uint16_t A1_RESTING = 4000;
-
-// A0 thresholds (values must be BELOW these to trigger)
-constexpr uint16_t A0_VOLUME_DOWN = 1890;
-constexpr uint16_t A0_RIGHT = 1860;
-constexpr uint16_t A0_ASSISTANT = 1820;
-constexpr uint16_t A0_VOLUME_UP = 980;
-constexpr uint16_t A0_DOWN = 900;
-constexpr uint16_t A0_PHONE = 850;
-constexpr uint16_t A0_RETURN = 550;
-constexpr uint16_t A0_PREV_SONG = 480;
-constexpr uint16_t A0_UP = 400;
-constexpr uint16_t A0_OK = 280;
-constexpr uint16_t A0_NEXT_SONG = 180;
-constexpr uint16_t A0_LEFT = 80;
-constexpr uint16_t A0_MODE = 0;
-
-// A1 thresholds (values must be BELOW these to trigger)
-constexpr uint16_t A1_LANE_ASSIST = 1980;
-constexpr uint16_t A1_RADAR = 1880;
-constexpr uint16_t A1_CC_MINUS = 1600;
-constexpr uint16_t A1_CC_PLUS = 820;
-constexpr uint16_t A1_CANCEL = 320;
-constexpr uint16_t A1_CRUISE_CONTROL = 0;
-}  // namespace Threshold
-
-// Button State Variables
-ButtonID previousA0 = ButtonID::NONE;
-ButtonID previousA1 = ButtonID::NONE;
-bool previousHorn = false;
-bool previousPaddleR = false;
-bool previousPaddleL = false;
-
-// Analog reset variables (prevents noise in some cases)
-bool a0WaitingForReset = false;
-bool a1WaitingForReset = false;
+// Latest backlight command from the car (written from the BLE stack, applied in loop())
+volatile uint8_t backlightCommand[2];
+volatile uint8_t backlightCommandLength = 0;
 
 void checkAndResetBLE() {
   errorCount++;
   if (errorCount >= ERROR_THRESHOLD) {
-    Serial.println("Too many BLE errors, restarting BLE stack");
-    BLEDevice::deinit(true);
-    delay(1000);
-    setup();  // Reinitialize BLE
-    errorCount = 0;
+    // The BLE objects are built once and never torn down, a clean restart is the only full reset
+    Serial.println("Too many BLE errors, restarting");
+    reportHeap();
+    delay(100);
+    ESP.restart();
   }
 }
 
@@ -118,16 +75,58 @@ class MyServerCallbacks : public BLEServerCallbacks {
     deviceConnected = true;
     errorCount = 0;  // Reset error count on successful connection
     Serial.println("Connected");
+    reportHeap();
+
+    recordLatency(timeToConnect, millis() - advertisingScheduler.phaseStart);
+    printLatencyHistogram("TTC", timeToConnect);
+
+    if (bootLink == 0) {
+      bootLink = millis();
+      Serial.print("BOOT,");
+      Serial.print(bootFirstSample);
+      Serial.print(",");
+      Serial.println(bootLink);
+    }
   };
 
+  void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) {
+    memcpy(carAddress, param->connect.remote_bda, sizeof(carAddress));
+    resetLink();
+  }
+
   void onDisconnect(BLEServer* pServer) {
     deviceConnected = false;
+    buttonDescriptor.setNotifications(false);  // The CCCD value outlives the connection
     Serial.println("Disconnected");
+    reportHeap();
     delay(500);
     BLEDevice::getAdvertising()->stop();
   }
 };
 
+// The car writes backlight commands and link reports to the button characteristic
+class ButtonCharacteristicCallbacks : public BLECharacteristicCallbacks {
+  void onWrite(BLECharacteristic* pCharacteristic) {
+    std::string value = pCharacteristic->getValue();
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(value.data());
+    if (receiveLinkReport(data, value.length()) > 0 || value.empty()) {
+      return;
+    }
+    if ((data[0] & 0x7F) == static_cast<int>(ButtonID::BACKLIGHT)) {
+      backlightCommand[0] = data[0];
+      backlightCommand[1] = value.length() > 1 ? data[1] : 0;
+      backlightCommandLength = value.length() > 1 ? 2 : 1;
+    }
+  }
+
+  // notify() reports its result here before returning
+  void onStatus(BLECharacteristic* pCharacteristic, Status s, uint32_t code) { notifySent = s == SUCCESS_NOTIFY; }
+};
+
+// BLE objects live for the whole run (never reallocated)
+static MyServerCallbacks serverCallbacks;
+static ButtonCharacteristicCallbacks buttonCallbacks;
+
 void startAdvertising() {
   // Stop any existing advertising first
   BLEDevice::getAdvertising()->stop();
@@ -135,136 +134,34 @@ void startAdvertising() {
 
   BLEAdvertising* pAdvertising = BLEDevice::getAdvertising();
 
-  // Set new advertising data
-  BLEAdvertisementData advertisementData;
-  advertisementData.setCompleteServices(BLEUUID(SERVICE_UUID));
-  advertisementData.setName("XIAO_ESP32S3_WHEEL");
-  pAdvertising->setAdvertisementData(advertisementData);
-
-  // Start advertising with specific parameters
+  // Start advertising (advertisement data is set once in beginBLE) with the current backoff step
+  pAdvertising->setMinInterval(ADVERTISING_STEPS[advertisingScheduler.step].minInterval);
+  pAdvertising->setMaxInterval(ADVERTISING_STEPS[advertisingScheduler.step].maxInterval);
   pAdvertising->start();
-  lastAdvertisingTime = millis();
 }
 
-bool confirmADCReading(int pin, int firstReading) {
-  delayMicroseconds(ADC_VERIFY_READ_DELAY);
-  int secondReading = analogRead(pin);
-  return abs(secondReading - firstReading) <= ADC_VERIFY_READ_RANGE;
-}
-
-uint16_t getAveragedADCReading(int pin) {
-  uint32_t sum = 0;
-  for (int i = 0; i < ADC_AVERAGE_SAMPLES; i++) {
-    sum += analogRead(pin);
-    delayMicroseconds(ADC_SAMPLE_DELAY_US);
-  }
-  return sum / ADC_AVERAGE_SAMPLES;
-}
-
-ButtonID getA0() {
-  uint16_t valueA0 = analogRead(PIN_A0);
-  Serial.println(valueA0);
-
-  // If waiting for reset, check if value has returned above resting threshold
-  if (a0WaitingForReset) {
-    if (valueA0 >= Threshold::A0_RESTING) {
-      a0WaitingForReset = false;
-      return ButtonID::NONE;
-    }
-    return previousA0;
-  }
-
-  // Check if A0 is significantly below resting state
-  if (valueA0 < (Threshold::A0_RESTING)) {
-    if (confirmADCReading(PIN_A0, valueA0)) {
-      // Get averaged reading
-      valueA0 = getAveragedADCReading(PIN_A0);
-      ButtonID result = ButtonID::NONE;
-
-      if (valueA0 > Threshold::A0_VOLUME_DOWN)
-        result = ButtonID::VOLUME_DOWN;
-      else if (valueA0 > Threshold::A0_RIGHT)
-        result = ButtonID::RIGHT;
-      else if (valueA0 > Threshold::A0_ASSISTANT)
-        result = ButtonID::ASSISTANT;
-      else if (valueA0 > Threshold::A0_VOLUME_UP)
-        result = ButtonID::VOLUME_UP;
-      else if (valueA0 > Threshold::A0_DOWN)
-        result = ButtonID::DOWN;
-      else if (valueA0 > Threshold::A0_PHONE)
-        result = ButtonID::PHONE;
-      else if (valueA0 > Threshold::A0_RETURN)
-        result = ButtonID::RETURN;
-      else if (valueA0 > Threshold::A0_PREV_SONG)
-        result = ButtonID::PREV_SONG;
-      else if (valueA0 > Threshold::A0_UP)
-        result = ButtonID::UP;
-      else if (valueA0 > Threshold::A0_OK)
-        result = ButtonID::OK;
-      else if (valueA0 > Threshold::A0_NEXT_SONG)
-        result = ButtonID::NEXT_SONG;
-      else if (valueA0 > Threshold::A0_LEFT)
-        result = ButtonID::LEFT;
-      else if (valueA0 >= Threshold::A0_MODE)
-        result = ButtonID::MODE;
-
-      if (result != ButtonID::NONE) {
-        a0WaitingForReset = true;
-        return result;
-      }
-    }
-  }
-
-  return ButtonID::NONE;
-}
-
-ButtonID getA1() {
-  uint16_t valueA1 = analogRead(PIN_A1);
+// Build the server, service and advertisement once, all later BLE activity reuses them
+void beginBLE() {
+  Serial.println("Starting BLE...");
+  BLEDevice::init("XIAO_ESP32S3_WHEEL");
+  beginLink();
+  pServer = BLEDevice::createServer();
+  pServer->setCallbacks(&serverCallbacks);
 
-  // If waiting for reset, check if value has returned above resting threshold
-  if (a1WaitingForReset) {
-    if (valueA1 >= Threshold::A1_RESTING) {
-      a1WaitingForReset = false;
-      return ButtonID::NONE;
-    }
-    return previousA1;
-  }
+  BLEService* pService = pServer->createService(SERVICE_UUID);
+  pCharacteristic = pService->createCharacteristic(CHARACTERISTIC_UUID, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY);
 
-  // Check if A1 is significantly below resting state
-  if (valueA1 < (Threshold::A1_RESTING)) {
-    if (confirmADCReading(PIN_A1, valueA1)) {
-      // Get averaged reading
-      valueA1 = getAveragedADCReading(PIN_A1);
-      ButtonID result = ButtonID::NONE;
-
-      if (valueA1 > Threshold::A1_LANE_ASSIST)
-        result = ButtonID::LANE_ASSIST;
-      else if (valueA1 > Threshold::A1_RADAR)
-        result = ButtonID::RADAR;
-      else if (valueA1 > Threshold::A1_CC_MINUS)
-        result = ButtonID::CC_MINUS;
-      else if (valueA1 > Threshold::A1_CC_PLUS)
-        result = ButtonID::CC_PLUS;
-      else if (valueA1 > Threshold::A1_CANCEL)
-        result = ButtonID::CANCEL;
-      else if (valueA1 >= Threshold::A1_CRUISE_CONTROL)
-        result = ButtonID::CRUISE_CONTROL;
-
-      if (result != ButtonID::NONE) {
-        a1WaitingForReset = true;
-        return result;
-      }
-    }
-  }
+  pCharacteristic->setCallbacks(&buttonCallbacks);
+  pCharacteristic->addDescriptor(&buttonDescriptor);
+  pService->start();
 
-  return ButtonID::NONE;
+  BLEAdvertisementData advertisementData;
+  advertisementData.setCompleteServices(BLEUUID(SERVICE_UUID));
+  advertisementData.setName("XIAO_ESP32S3_WHEEL");
+  BLEDevice::getAdvertising()->setAdvertisementData(advertisementData);
 }
 
-bool getHorn() { return digitalRead(PIN_HORN) == LOW; }
-
-bool getPaddleR() { return digitalRead(PIN_PADDLE_RIGHT) == LOW; }
-
-bool getPaddleL() { return digitalRead(PIN_PADDLE_LEFT) == LOW; }
+void setBacklight(uint8_t brightness) { ledcWrite(BACKLIGHT_PWM_CHANNEL, brightness); }
 
 void setup() {
   Serial.begin(115200);
@@ -273,114 +170,125 @@ void setup() {
   // Pin Setup
   pinMode(PIN_A0, INPUT);
   pinMode(PIN_A1, INPUT);
+  pinMode(PIN_A2, INPUT);
   pinMode(PIN_HORN, INPUT);
   pinMode(PIN_PADDLE_RIGHT, INPUT);
   pinMode(PIN_PADDLE_LEFT, INPUT);
-  pinMode(PIN_BACKLIGHT, OUTPUT);
-  digitalWrite(PIN_BACKLIGHT, LOW);
 
-  // BLE Setup
-  Serial.println("Starting BLE...");
-  BLEDevice::init("XIAO_ESP32S3_WHEEL");
-  pServer = BLEDevice::createServer();
-  pServer->setCallbacks(new MyServerCallbacks());
+  // Load the usage counters before the sampler starts adding to them
+  beginStats();
 
-  BLEService* pService = pServer->createService(SERVICE_UUID);
-  pCharacteristic = pService->createCharacteristic(CHARACTERISTIC_UUID, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY);
+  // Capture presses from here on, events are queued until the link is up
+  beginInputSampling();
 
-  pCharacteristic->addDescriptor(new BLE2902());
-  pService->start();
+  ledcSetup(BACKLIGHT_PWM_CHANNEL, BACKLIGHT_PWM_FREQ, BACKLIGHT_PWM_RESOLUTION);
+  ledcAttachPin(PIN_BACKLIGHT, BACKLIGHT_PWM_CHANNEL);
+  setBacklight(0);
+
+  // BLE Setup
+  beginBLE();
 
   // Start advertising
+  resetDiscovery(advertisingScheduler, millis());
   startAdvertising();
   Serial.println("Ready");
+  reportHeap();
 }
 
-void handleButtonStateChange(bool currentState, bool& previousState, ButtonID buttonId) {
-  if (currentState != previousState) {
-    uint8_t value = static_cast<uint8_t>(buttonId);
-    if (previousState) {
-      value |= 0x80;  // off flag
-    }
-    if (currentState || previousState) {  // only send if there's a change to report
-      pCharacteristic->setValue(&value, 1);
-      pCharacteristic->notify();
-    }
-    previousState = currentState;
-  }
-}
-
-void handleButtonIDStateChange(ButtonID currentButton, ButtonID& previousButton) {
-  if (currentButton != previousButton) {
-    if (previousButton != ButtonID::NONE) {
-      uint8_t value = static_cast<uint8_t>(previousButton) | 0x80;  // off flag
-      pCharacteristic->setValue(&value, 1);
-      pCharacteristic->notify();
-    }
-    if (currentButton != ButtonID::NONE) {
-      uint8_t value = static_cast<uint8_t>(currentButton);
-      pCharacteristic->setValue(&value, 1);
-      pCharacteristic->notify();
-    }
-    previousButton = currentButton;
+// Serial commands: "stats" prints the usage counters, "stats clear" resets them
+const ConsoleCommand SERIAL_COMMANDS[] = {
+    {"stats", printStats},
+    {"stats clear", clearStats},
+};
+const uint8_t SERIAL_COMMAND_COUNT = sizeof(SERIAL_COMMANDS) / sizeof(SERIAL_COMMANDS[0]);
+
+// Every notification starts with a link report (a report alone is the heartbeat). Returns false
+// when the stack did not take it (notifications disabled, no client or a GATT error).
+bool notifyButtonValues(uint8_t* values, size_t length) {
+  uint8_t frame[LINK_HEADER_SIZE + EVENT_BATCH_SIZE];
+  writeLinkHeader(frame, millis());
+  if (length > 0) {
+    memcpy(frame + LINK_HEADER_SIZE, values, length);
   }
+  pCharacteristic->setValue(frame, LINK_HEADER_SIZE + length);
+  notifySent = false;
+  pCharacteristic->notify();
+  return notifySent;
 }
 
 void loop() {
   // Handle BLE connection state
   if (!deviceConnected && oldDeviceConnected) {
-    pServer->startAdvertising();  // Restart advertising
+    resetDiscovery(advertisingScheduler, millis());
+    startAdvertising();  // Restart fast advertising
     oldDeviceConnected = deviceConnected;
-    lastAdvertisingTime = millis();
   }
 
   if (deviceConnected && !oldDeviceConnected) {
     oldDeviceConnected = deviceConnected;
   }
 
-  // Only restart advertising if enough time has passed and we're not connected
-  if (!deviceConnected && (millis() - lastAdvertisingTime >= ADVERTISING_INTERVAL)) {
+  // Only restart advertising when the backoff step changes and we're not connected
+  if (!deviceConnected && updateDiscovery(advertisingScheduler, ADVERTISING_STEPS, ADVERTISING_STEP_COUNT, millis())) {
     try {
       startAdvertising();
     } catch (...) {
       checkAndResetBLE();
-      lastAdvertisingTime = millis() + ADVERTISING_INTERVAL;
+    }
+  }
+
+  // Events wait in the queue until the car has subscribed (it connects before discovering the
+  // service and writing the CCCD), anything the stack refuses is retried on the next pass
+  bool flushed = false;
+  if (deviceConnected && buttonDescriptor.getNotifications()) {
+    // Send button changes captured by the sampler (including any backlog from before the link)
+    flushed = flushButtonEvents(notifyButtonValues);
+
+    // Heartbeat keeps sequence gaps and RSSI visible while no buttons are pressed
+    if (linkReportDue(millis())) {
+      notifyButtonValues(nullptr, 0);
+      requestLinkRssi(carAddress);
     }
   }
 
   if (deviceConnected) {
-    // Handle button states
-    ButtonID currentA0 = getA0();
-    ButtonID currentA1 = getA1();
-    bool currentHorn = getHorn();
-    bool currentPaddleR = getPaddleR();
-    bool currentPaddleL = getPaddleL();
-
-    handleButtonIDStateChange(currentA0, previousA0);
-    handleButtonIDStateChange(currentA1, previousA1);
-    handleButtonStateChange(currentHorn, previousHorn, ButtonID::HORN);
-    handleButtonStateChange(currentPaddleR, previousPaddleR, ButtonID::PADDLE_RIGHT);
-    handleButtonStateChange(currentPaddleL, previousPaddleL, ButtonID::PADDLE_LEFT);
-
-    // get backlight state if data available
-    std::string value = pCharacteristic->getValue();
-    if (value.length() > 0) {
-      uint8_t receivedState = value[0];
-      if ((receivedState & 0x7F) == static_cast<int>(ButtonID::BACKLIGHT)) {
-        backlightState = (receivedState & 0x80) >> 7;
-        digitalWrite(PIN_BACKLIGHT, !backlightState);  // 1 is off, 0 is on (using received flag)
+    unsigned long now = millis();
+    updateLinkPower(now, true);
+    if (linkPrintDue(now)) {
+      printLink(now);
+    }
+
+    // Apply the last backlight command from the car
+    if (backlightCommandLength > 0) {
+      uint8_t receivedState = backlightCommand[0];
+      backlightState = (receivedState & 0x80) >> 7;
+      if (backlightCommandLength > 1 && !backlightState) {
+        setBacklight(backlightCommand[1]);  // Dimmer brightness measured by the car
+      } else {
+        setBacklight(backlightState ? 0 : 255);  // 1 is off, 0 is on (using received flag)
       }
     }
   }
 
+  updateHeapReport(millis());
+
+  updateStats(millis());
+  handleSerialCommands(SERIAL_COMMANDS, SERIAL_COMMAND_COUNT);
+
   // Handle backlight behavior
   if (!deviceConnected) {
     if (millis() - lastBacklightToggleTime >= 500) {
       backlightState = !backlightState;
-      digitalWrite(PIN_BACKLIGHT, backlightState);
+      setBacklight(backlightState ? 255 : 0);
       lastBacklightToggleTime = millis();
     }
   }
 
-  delay(100);
+  // Wake early when the sampler queues an event (a backlog still waiting to be sent would wake it
+  // straight away, so that case polls)
+  if (flushed) {
+    waitForButtonEvent(100);
+  } else {
+    delay(100);
+  }
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+// Generated by tools/thresholds.py from the KiCad schematics, do not edit.
+// Raw ADC code bands (11 dB attenuation) including resistor, supply and ADC spread.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "button_id.hpp"
+
+struct LadderBand {
+  ButtonID button;
+  uint16_t low;
+  uint16_t high;
+};
+
+namespace LadderThreshold {
+// A0 resting 0 to 40
+constexpr uint16_t A0_RESTING_HIGH = 40;
+constexpr LadderBand A0_BANDS[] = {
+    {ButtonID::VOLUME_DOWN, 253, 406},  // 0.265 V
+    {ButtonID::VOLUME_UP, 568, 780},    // 0.542 V
+    {ButtonID::PREV_SONG, 888, 1142},   // 0.812 V
+    {ButtonID::NEXT_SONG, 1209, 1489},  // 1.077 V
+    {ButtonID::RETURN, 1843, 2292},     // 1.648 V
+    {ButtonID::OK, 3903, 4095},         // 3.290 V
+};
+constexpr size_t A0_BAND_COUNT = sizeof(A0_BANDS) / sizeof(A0_BANDS[0]);
+
+// A1 resting 0 to 40
+constexpr uint16_t A1_RESTING_HIGH = 40;
+constexpr LadderBand A1_BANDS[] = {
+    {ButtonID::RIGHT, 253, 406},          // 0.265 V
+    {ButtonID::DOWN, 568, 780},           // 0.542 V
+    {ButtonID::UP, 888, 1142},            // 0.812 V
+    {ButtonID::LEFT, 1209, 1489},         // 1.077 V
+    {ButtonID::LANE_ASSIST, 2148, 2632},  // 1.907 V
+    {ButtonID::RADAR, 3903, 4095},        // 3.290 V
+};
+constexpr size_t A1_BAND_COUNT = sizeof(A1_BANDS) / sizeof(A1_BANDS[0]);
+
+// A2 resting 0 to 40
+constexpr uint16_t A2_RESTING_HIGH = 40;
+constexpr LadderBand A2_BANDS[] = {
+    {ButtonID::ASSISTANT, 625, 847},         // 0.591 V
+    {ButtonID::PHONE, 945, 1207},            // 0.861 V
+    {ButtonID::MODE, 1235, 1520},            // 1.100 V
+    {ButtonID::CC_MINUS, 1603, 2024},        // 1.445 V
+    {ButtonID::CC_PLUS, 2449, 2963},         // 2.163 V
+    {ButtonID::CANCEL, 3156, 3749},          // 2.748 V
+    {ButtonID::CRUISE_CONTROL, 3913, 4095},  // 3.297 V
+};
+constexpr size_t A2_BAND_COUNT = sizeof(A2_BANDS) / sizeof(A2_BANDS[0]);
+}  // namespace LadderThreshold
+
+// Button whose band contains value, NONE between bands
+inline ButtonID decodeLadder(const LadderBand* bands, size_t count, uint16_t value) {
+  for (size_t i = 0; i < count; i++) {
+    if (value >= bands[i].low && value <= bands[i].high) {
+      return bands[i].button;
+    }
+  }
+  return ButtonID::NONE;
+}
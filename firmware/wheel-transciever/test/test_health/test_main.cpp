@@ -0,0 +1,129 @@
+#include <unity.h>
+
+#include "../../src/health.hpp"
+
+// Synthetic ADC traces for the ladder health monitor (pio test -e native).
+// Levels follow the generated A0 bands: resting low, a button inside the first band and the
+// gap between the first two bands.
+#define TEST_LEVEL_RESTING 0
+#define TEST_LEVEL_BUTTON ((LadderThreshold::A0_BANDS[0].low + LadderThreshold::A0_BANDS[0].high) / 2)
+#define TEST_LEVEL_OUT_OF_BAND ((LadderThreshold::A0_BANDS[0].high + LadderThreshold::A0_BANDS[1].low) / 2)
+#define TEST_START 1000  // First reading, milliseconds after boot
+#define NO_CHANGE 0xFFFFFFFFUL
+
+static LadderMonitor monitor;
+
+void setUp() { monitor = {LadderThreshold::A0_RESTING_HIGH, LadderThreshold::A0_BANDS, LadderThreshold::A0_BAND_COUNT, ChannelHealth::OK, false, false, 0, 0, 0, 0, 0}; }
+
+void tearDown() {}
+
+// Feed the same reading every millisecond in [from, to), returns when the health changed
+static unsigned long holdLevel(uint16_t value, unsigned long from, unsigned long to) {
+  for (unsigned long now = from; now < to; now++) {
+    if (updateLadderHealth(monitor, value, now)) {
+      return now;
+    }
+  }
+  return NO_CHANGE;
+}
+
+void test_resting_stays_ok() {
+  TEST_ASSERT_EQUAL_UINT32(NO_CHANGE, holdLevel(TEST_LEVEL_RESTING, TEST_START, TEST_START + 60000));
+  TEST_ASSERT_FALSE(ladderDegraded(monitor));
+}
+
+void test_stuck_pressed_after_timeout() {
+  TEST_ASSERT_EQUAL_UINT32(TEST_START + LADDER_STUCK_PRESSED_TIMEOUT, holdLevel(TEST_LEVEL_BUTTON, TEST_START, TEST_START + 20000));
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(ChannelHealth::STUCK_PRESSED), static_cast<int>(monitor.health));
+}
+
+void test_press_shorter_than_timeout_is_ok() {
+  TEST_ASSERT_EQUAL_UINT32(NO_CHANGE, holdLevel(TEST_LEVEL_BUTTON, TEST_START, TEST_START + LADDER_STUCK_PRESSED_TIMEOUT - 1));
+  TEST_ASSERT_EQUAL_UINT32(NO_CHANGE, holdLevel(TEST_LEVEL_RESTING, TEST_START + LADDER_STUCK_PRESSED_TIMEOUT - 1, TEST_START + 20000));
+  TEST_ASSERT_FALSE(ladderDegraded(monitor));
+}
+
+void test_out_of_band_after_timeout() {
+  TEST_ASSERT_EQUAL_UINT32(TEST_START + LADDER_OUT_OF_BAND_TIMEOUT, holdLevel(TEST_LEVEL_OUT_OF_BAND, TEST_START, TEST_START + 1000));
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(ChannelHealth::OUT_OF_BAND), static_cast<int>(monitor.health));
+}
+
+void test_out_of_band_passing_through_is_ok() {
+  // Settling through the gap on the way to a button band
+  TEST_ASSERT_EQUAL_UINT32(NO_CHANGE, holdLevel(TEST_LEVEL_OUT_OF_BAND, TEST_START, TEST_START + LADDER_OUT_OF_BAND_TIMEOUT - 1));
+  TEST_ASSERT_EQUAL_UINT32(NO_CHANGE, holdLevel(TEST_LEVEL_BUTTON, TEST_START + LADDER_OUT_OF_BAND_TIMEOUT - 1, TEST_START + 2000));
+  TEST_ASSERT_FALSE(ladderDegraded(monitor));
+}
+
+void test_flapping_at_transition_limit() {
+  // One press/release transition every 100ms, all inside one window
+  unsigned long now = TEST_START;
+  for (int transition = 1; transition < LADDER_FLAP_LIMIT; transition++) {
+    TEST_ASSERT_FALSE(updateLadderHealth(monitor, transition % 2 ? TEST_LEVEL_BUTTON : TEST_LEVEL_RESTING, now));
+    now += 100;
+  }
+  TEST_ASSERT_TRUE(updateLadderHealth(monitor, LADDER_FLAP_LIMIT % 2 ? TEST_LEVEL_BUTTON : TEST_LEVEL_RESTING, now));
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(ChannelHealth::FLAPPING), static_cast<int>(monitor.health));
+  TEST_ASSERT_TRUE(now - TEST_START <= LADDER_FLAP_WINDOW);
+}
+
+void test_transitions_spread_over_window_are_ok() {
+  // The limit is reached only after the window has passed, so the count starts over
+  unsigned long period = LADDER_FLAP_WINDOW / (LADDER_FLAP_LIMIT - 1) + 10;
+  unsigned long now = TEST_START;
+  for (int transition = 1; transition <= 2 * LADDER_FLAP_LIMIT; transition++) {
+    TEST_ASSERT_FALSE(updateLadderHealth(monitor, transition % 2 ? TEST_LEVEL_BUTTON : TEST_LEVEL_RESTING, now));
+    now += period;
+  }
+  TEST_ASSERT_FALSE(ladderDegraded(monitor));
+}
+
+void test_recovery_after_resting_time() {
+  unsigned long stuck = holdLevel(TEST_LEVEL_BUTTON, TEST_START, TEST_START + 20000);
+  TEST_ASSERT_EQUAL_UINT32(TEST_START + LADDER_STUCK_PRESSED_TIMEOUT, stuck);
+
+  unsigned long resting = stuck + 1;
+  TEST_ASSERT_EQUAL_UINT32(resting + LADDER_RECOVERY_TIME, holdLevel(TEST_LEVEL_RESTING, resting, resting + 5000));
+  TEST_ASSERT_FALSE(ladderDegraded(monitor));
+}
+
+void test_recovery_restarts_on_dip() {
+  unsigned long stuck = holdLevel(TEST_LEVEL_BUTTON, TEST_START, TEST_START + 20000);
+
+  // A press just before the recovery time starts the wait over
+  unsigned long resting = stuck + 1;
+  unsigned long dip = resting + LADDER_RECOVERY_TIME - 1;
+  TEST_ASSERT_EQUAL_UINT32(NO_CHANGE, holdLevel(TEST_LEVEL_RESTING, resting, dip));
+  TEST_ASSERT_FALSE(updateLadderHealth(monitor, TEST_LEVEL_BUTTON, dip));
+  TEST_ASSERT_EQUAL_UINT32(dip + 1 + LADDER_RECOVERY_TIME, holdLevel(TEST_LEVEL_RESTING, dip + 1, dip + 5000));
+}
+
+void test_recovery_from_flapping_clears_count() {
+  unsigned long now = TEST_START;
+  for (int transition = 1; transition <= LADDER_FLAP_LIMIT; transition++) {
+    updateLadderHealth(monitor, transition % 2 ? TEST_LEVEL_BUTTON : TEST_LEVEL_RESTING, now);
+    now += 50;
+  }
+  TEST_ASSERT_TRUE(ladderDegraded(monitor));
+
+  // Settle at rest, recover, then a single press must not trip the monitor again
+  unsigned long recovered = holdLevel(TEST_LEVEL_RESTING, now, now + 5000);
+  TEST_ASSERT_NOT_EQUAL(NO_CHANGE, recovered);
+  TEST_ASSERT_FALSE(ladderDegraded(monitor));
+  TEST_ASSERT_EQUAL_UINT32(NO_CHANGE, holdLevel(TEST_LEVEL_BUTTON, recovered + 1, recovered + 200));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_resting_stays_ok);
+  RUN_TEST(test_stuck_pressed_after_timeout);
+  RUN_TEST(test_press_shorter_than_timeout_is_ok);
+  RUN_TEST(test_out_of_band_after_timeout);
+  RUN_TEST(test_out_of_band_passing_through_is_ok);
+  RUN_TEST(test_flapping_at_transition_limit);
+  RUN_TEST(test_transitions_spread_over_window_are_ok);
+  RUN_TEST(test_recovery_after_resting_time);
+  RUN_TEST(test_recovery_restarts_on_dip);
+  RUN_TEST(test_recovery_from_flapping_clears_count);
+  return UNITY_END();
+}
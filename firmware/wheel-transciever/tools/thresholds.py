@@ -0,0 +1,402 @@
+#!/usr/bin/env python3
+"""Generate src/thresholds.hpp from the KiCad ladder schematics.
+
+Runs before every PlatformIO build (extra_scripts), or by hand:
+    python3 tools/thresholds.py
+
+The wheel's switch ladder (hardware/reference) and the transceiver's divider
+(hardware/wheel-transceiver) are joined by harness wire colour. For every switch
+the combined network is solved with that switch closed, the voltage spread is
+taken over the resistor and supply tolerances, and the result is mapped through
+the ADC response to a band of raw codes. Overlapping bands on any channel fail
+the build, the header is left as it was.
+"""
+
+import math
+import os
+import re
+import sys
+
+SCHEMATICS = [
+    # (path from the repository root, resistor tolerance)
+    ("hardware/reference/steering-wheel-buttons.kicad_sch", 0.05),  # Measured Toyota parts
+    ("hardware/wheel-transceiver/corolla-wheel-final.kicad_sch", 0.01),
+]
+
+SUPPLY_NET = "3V3"
+GROUND_NET = "GND"
+SUPPLY_VOLTAGE = 3.3
+SUPPLY_TOLERANCE = 0.03
+SWITCH_RESISTANCE = 1.0  # ohms, closed contact
+LEAKAGE = 1e-9           # siemens to ground, keeps floating nodes solvable
+
+# Typical ESP32-S3 raw response at 11 dB attenuation (millivolts, code)
+ADC_CURVE = [
+    (0, 0), (500, 620), (1000, 1250), (1500, 1880), (2000, 2500),
+    (2500, 3120), (2900, 3640), (3100, 3950), (3200, 4095),
+]
+ADC_GAIN_ERROR = 0.03  # Chip to chip
+ADC_NOISE = 40         # codes
+
+# Switch value in the wheel schematic -> ButtonID (../shared/button_id.hpp)
+SWITCH_BUTTONS = {
+    "Volume -": "VOLUME_DOWN",
+    "Volume +": "VOLUME_UP",
+    "Previous Song": "PREV_SONG",
+    "Next Song": "NEXT_SONG",
+    "Return": "RETURN",
+    "Ok": "OK",
+    "Up": "UP",
+    "Down": "DOWN",
+    "Left": "LEFT",
+    "Right": "RIGHT",
+    "Face": "ASSISTANT",
+    "Phone": "PHONE",
+    "Mode": "MODE",
+    "Lane Assist": "LANE_ASSIST",
+    "Radar": "RADAR",
+    "Cruise Control Enable": "CRUISE_CONTROL",
+    "Cancel": "CANCEL",
+    "Res": "CC_PLUS",
+    "Set": "CC_MINUS",
+}
+
+ADC_NET = re.compile(r"^A\d$")
+
+
+# Schematic parsing
+
+def parse_sexpr(text):
+    stack = [[]]
+    for token in re.findall(r'\(|\)|"(?:[^"\\]|\\.)*"|[^\s()]+', text):
+        if token == "(":
+            stack.append([])
+        elif token == ")":
+            node = stack.pop()
+            stack[-1].append(node)
+        elif token.startswith('"'):
+            stack[-1].append(token[1:-1])
+        else:
+            stack[-1].append(token)
+    return stack[0][0]
+
+
+def children(node, name):
+    return [c for c in node[1:] if isinstance(c, list) and c and c[0] == name]
+
+
+def child(node, name):
+    found = children(node, name)
+    return found[0] if found else None
+
+
+def field(node, name):
+    for prop in children(node, "property"):
+        if prop[1] == name:
+            return prop[2]
+    return None
+
+
+def point(x, y):
+    return (round(float(x), 2), round(float(y), 2))
+
+
+def position(node):
+    at = child(node, "at")
+    return point(at[1], at[2])
+
+
+def symbol_pins(symbol, libraries):
+    """Yield (pin number, schematic position) for a placed symbol."""
+    library = libraries[child(symbol, "lib_id")[1]]
+    at = child(symbol, "at")
+    x, y = float(at[1]), float(at[2])
+    angle = math.radians(-float(at[3]) if len(at) > 3 else 0)
+    mirror = child(symbol, "mirror")
+    unit = int(child(symbol, "unit")[1]) if child(symbol, "unit") else 1
+
+    for body in children(library, "symbol"):
+        body_unit = int(re.search(r"_(\d+)_\d+$", body[1]).group(1))
+        if body_unit not in (0, unit):
+            continue
+        for pin in children(body, "pin"):
+            pin_at = child(pin, "at")
+            px, py = float(pin_at[1]), -float(pin_at[2])  # Library y axis points up
+            rx = px * math.cos(angle) - py * math.sin(angle)
+            ry = px * math.sin(angle) + py * math.cos(angle)
+            if mirror and mirror[1] == "x":
+                ry = -ry
+            if mirror and mirror[1] == "y":
+                rx = -rx
+            yield child(pin, "number")[1], point(x + rx, y + ry)
+
+
+def on_segment(p, a, b):
+    cross = (b[0] - a[0]) * (p[1] - a[1]) - (b[1] - a[1]) * (p[0] - a[0])
+    return (abs(cross) < 1e-3
+            and min(a[0], b[0]) - 1e-3 <= p[0] <= max(a[0], b[0]) + 1e-3
+            and min(a[1], b[1]) - 1e-3 <= p[1] <= max(a[1], b[1]) + 1e-3)
+
+
+class Netlist:
+    def __init__(self):
+        self.parent = {}
+        self.parts = []  # (reference, value, {pin: node}, tolerance)
+
+    def find(self, node):
+        self.parent.setdefault(node, node)
+        while self.parent[node] != node:
+            self.parent[node] = self.parent[self.parent[node]]
+            node = self.parent[node]
+        return node
+
+    def join(self, a, b):
+        self.parent[self.find(a)] = self.find(b)
+
+    def net(self, name):
+        return self.find(("net", name.upper()))
+
+    def load(self, path, tolerance):
+        sheet = os.path.basename(path)
+        root = parse_sexpr(open(path).read())
+        libraries = {s[1]: s for s in children(child(root, "lib_symbols"), "symbol")}
+
+        # Anything that can sit on a wire
+        anchors = []
+        for symbol in children(root, "symbol"):
+            lib_id = child(symbol, "lib_id")[1]
+            pins = {}
+            for number, at in symbol_pins(symbol, libraries):
+                pins[number] = (sheet, at)
+                anchors.append(at)
+                if lib_id.startswith("power:"):
+                    self.join((sheet, at), ("net", field(symbol, "Value").upper()))
+            self.parts.append((field(symbol, "Reference"), field(symbol, "Value"), pins, tolerance))
+
+        # Global labels are harness wires and XIAO pins, matched by name across both sheets.
+        # The reference sheet marks its two supply wires (White, Black) with netclass flags.
+        for label in children(root, "global_label"):
+            anchors.append(position(label))
+            self.join((sheet, position(label)), ("net", label[1].upper()))
+        for flag in children(root, "netclass_flag"):
+            anchors.append(position(flag))
+            self.join((sheet, position(flag)), ("net", field(flag, "Netclass").split()[0].upper()))
+        for label in children(root, "label"):
+            anchors.append(position(label))
+            self.join((sheet, position(label)), (sheet, "label", label[1]))
+        for junction in children(root, "junction"):
+            anchors.append(position(junction))
+
+        for wire in children(root, "wire"):
+            a, b = [point(xy[1], xy[2]) for xy in children(child(wire, "pts"), "xy")]
+            self.join((sheet, a), (sheet, b))
+            for anchor in anchors:
+                if on_segment(anchor, a, b):
+                    self.join((sheet, anchor), (sheet, a))
+
+
+# Circuit solving
+
+def resistance(value):
+    match = re.match(r"^([\d.]+)\s*([kKM]?)", value)
+    if not match:
+        return None
+    return float(match.group(1)) * {"": 1, "k": 1e3, "K": 1e3, "M": 1e6}[match.group(2)]
+
+
+def solve(resistors, supply, ground, voltage):
+    """Node voltages of a resistor network, supply and ground held fixed."""
+    nodes = sorted({n for _, a, b in resistors for n in (a, b)} - {supply, ground}, key=str)
+    index = {n: i for i, n in enumerate(nodes)}
+    size = len(nodes)
+    matrix = [[0.0] * (size + 1) for _ in range(size)]
+
+    for i in range(size):
+        matrix[i][i] = LEAKAGE
+    for ohms, a, b in resistors:
+        g = 1.0 / ohms
+        for x, y in ((a, b), (b, a)):
+            if x not in index:
+                continue
+            matrix[index[x]][index[x]] += g
+            if y in index:
+                matrix[index[x]][index[y]] -= g
+            elif y == supply:
+                matrix[index[x]][size] += g * voltage
+
+    # Gauss-Jordan with partial pivoting
+    for i in range(size):
+        pivot = max(range(i, size), key=lambda r: abs(matrix[r][i]))
+        matrix[i], matrix[pivot] = matrix[pivot], matrix[i]
+        for r in range(size):
+            if r != i and matrix[r][i] != 0:
+                scale = matrix[r][i] / matrix[i][i]
+                matrix[r] = [x - scale * y for x, y in zip(matrix[r], matrix[i])]
+
+    result = {n: matrix[index[n]][size] / matrix[index[n]][index[n]] for n in nodes}
+    result[supply] = voltage
+    result[ground] = 0.0
+    return result
+
+
+def voltage_spread(resistors, tolerances, extra, supply, ground, adc):
+    """Nominal, lowest and highest voltage at the adc node (linearised worst case)."""
+    nominal = solve(resistors + extra, supply, ground, SUPPLY_VOLTAGE).get(adc, 0.0)
+    low = high = nominal
+
+    corners = []
+    for i, (ohms, a, b) in enumerate(resistors):
+        for sign in (-1, 1):
+            varied = list(resistors)
+            varied[i] = (ohms * (1 + sign * tolerances[i]), a, b)
+            corners.append(solve(varied + extra, supply, ground, SUPPLY_VOLTAGE))
+        deltas = [c.get(adc, 0.0) - nominal for c in corners[-2:]]
+        low += min(deltas + [0.0])
+        high += max(deltas + [0.0])
+
+    for sign in (-1, 1):
+        delta = nominal * sign * SUPPLY_TOLERANCE  # Every node scales with the supply
+        low = min(low, low + delta)
+        high = max(high, high + delta)
+    return nominal, max(low, 0.0), high
+
+
+def adc_code(millivolts):
+    for (v0, c0), (v1, c1) in zip(ADC_CURVE, ADC_CURVE[1:]):
+        if millivolts <= v1:
+            return c0 + (c1 - c0) * (max(millivolts, v0) - v0) / (v1 - v0)
+    return ADC_CURVE[-1][1]
+
+
+def code_band(low, high):
+    bottom = adc_code(low * 1000 * (1 - ADC_GAIN_ERROR)) - ADC_NOISE
+    top = adc_code(high * 1000 * (1 + ADC_GAIN_ERROR)) + ADC_NOISE
+    return max(int(math.floor(bottom)), 0), min(int(math.ceil(top)), 4095)
+
+
+# Generation
+
+def build_bands(netlist):
+    supply = netlist.net(SUPPLY_NET)
+    ground = netlist.net(GROUND_NET)
+    channels = {}
+    for name in sorted({n[1] for n in netlist.parent if n[0] == "net" and ADC_NET.match(n[1])}):
+        channels[name] = netlist.find(("net", name))
+
+    resistors, tolerances, switches = [], [], []
+    for reference, value, pins, tolerance in netlist.parts:
+        nodes = [netlist.find(pins[p]) for p in sorted(pins)]
+        if reference.startswith("R") and len(nodes) == 2 and resistance(value):
+            resistors.append((resistance(value), nodes[0], nodes[1]))
+            tolerances.append(tolerance)
+        elif reference.startswith("SW"):
+            switches.append((value, nodes[0], nodes[1]))
+
+    bands = {name: [] for name in channels}
+    resting = {}
+    for name, node in channels.items():
+        _, low, high = voltage_spread(resistors, tolerances, [], supply, ground, node)
+        resting[name] = code_band(low, high)
+
+    for value, a, b in switches:
+        if value not in SWITCH_BUTTONS:
+            raise SystemExit("thresholds: no ButtonID for switch '%s'" % value)
+        closed = [(SWITCH_RESISTANCE, a, b)]
+        for name, node in channels.items():
+            nominal, low, high = voltage_spread(resistors, tolerances, closed, supply, ground, node)
+            band = code_band(low, high)
+            if band[0] > resting[name][1]:  # Only the channel this switch drives moves
+                bands[name].append((SWITCH_BUTTONS[value], nominal, band))
+
+    for name in bands:
+        bands[name].sort(key=lambda b: b[2][0])
+    return resting, bands
+
+
+def find_overlaps(resting, bands):
+    overlaps = {}
+    for name, channel in bands.items():
+        previous = ("resting", None, resting[name])
+        for band in channel:
+            if band[2][0] <= previous[2][1]:
+                overlaps.setdefault(name, []).append((previous[0], band[0]))
+            previous = band
+    return overlaps
+
+
+def render(resting, bands):
+    lines = [
+        "#pragma once",
+        "",
+        "// Generated by tools/thresholds.py from the KiCad schematics, do not edit.",
+        "// Raw ADC code bands (11 dB attenuation) including resistor, supply and ADC spread.",
+        "",
+        "#include <stddef.h>",
+        "#include <stdint.h>",
+        "",
+        "#include \"button_id.hpp\"",
+        "",
+        "struct LadderBand {",
+        "  ButtonID button;",
+        "  uint16_t low;",
+        "  uint16_t high;",
+        "};",
+        "",
+        "namespace LadderThreshold {",
+    ]
+    for name in sorted(bands):
+        lines.append("// %s resting %d to %d" % (name, resting[name][0], resting[name][1]))
+        lines.append("constexpr uint16_t %s_RESTING_HIGH = %d;" % (name, resting[name][1]))
+        lines.append("constexpr LadderBand %s_BANDS[] = {" % name)
+        entries = ["{ButtonID::%s, %d, %d}," % (button, low, high) for button, _, (low, high) in bands[name]]
+        width = max(len(e) for e in entries)
+        for entry, (_, nominal, _) in zip(entries, bands[name]):
+            lines.append("    %s  // %.3f V" % (entry.ljust(width), nominal))
+        lines.append("};")
+        lines.append("constexpr size_t %s_BAND_COUNT = sizeof(%s_BANDS) / sizeof(%s_BANDS[0]);" % (name, name, name))
+        lines.append("")
+    lines[-1] = "}  // namespace LadderThreshold"
+    lines.append("")
+    lines.append("// Button whose band contains value, NONE between bands")
+    lines.append("inline ButtonID decodeLadder(const LadderBand* bands, size_t count, uint16_t value) {")
+    lines.append("  for (size_t i = 0; i < count; i++) {")
+    lines.append("    if (value >= bands[i].low && value <= bands[i].high) {")
+    lines.append("      return bands[i].button;")
+    lines.append("    }")
+    lines.append("  }")
+    lines.append("  return ButtonID::NONE;")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def generate(project):
+    root = os.path.normpath(os.path.join(project, "..", ".."))
+    netlist = Netlist()
+    for path, tolerance in SCHEMATICS:
+        netlist.load(os.path.join(root, path), tolerance)
+
+    resting, bands = build_bands(netlist)
+
+    # Every ladder is sampled, a reading two buttons share can't be decoded
+    overlaps = find_overlaps(resting, bands)
+    for name, pairs in sorted(overlaps.items()):
+        for a, b in pairs:
+            print("thresholds: %s bands overlap: %s and %s" % (name, a, b))
+    if overlaps:
+        return False
+
+    output = os.path.join(project, "src", "thresholds.hpp")
+    text = render(resting, bands)
+    if not os.path.exists(output) or open(output).read() != text:
+        open(output, "w").write(text)
+        print("thresholds: wrote %s" % os.path.relpath(output, project))
+    return True
+
+
+try:
+    Import("env")  # Running as a PlatformIO pre: script
+    if not generate(env["PROJECT_DIR"]):
+        env.Exit(1)
+except NameError:
+    if __name__ == "__main__":
+        sys.exit(0 if generate(os.path.dirname(os.path.dirname(os.path.abspath(__file__)))) else 1)